@@ -0,0 +1,575 @@
+/*
+Asynchronous evaluation with C++20 coroutines
+
+co_await calculator.eval_async(expression) runs the stages of an evaluation as tasks of a TaskScheduler:
+    parse       the expression is compiled once and cached, under the lock of the wrapped Calculator
+    optimize    a newly compiled expression is promoted to bytecode by a task of its own
+    evaluate    the requests waiting on the same compiled expression are evaluated together by evaluate_batch
+
+The first request waiting on an expression defers a flush task, behind the requests already submitted to the
+scheduler, and the requests arriving before it runs or while
+its batch is evaluated join the next batch. There is no timer, so a request is never delayed waiting for
+others, and batches grow with the load. Batches hold at most max_batch_size requests, which bounds the wait
+of a request under bursts to the evaluation of the batches queued before it.
+
+Task<T> is a lazy coroutine which starts when it is awaited, sync_wait runs one from ordinary code.
+The AsyncCalculator must outlive its requests.
+*/
+
+#pragma once
+
+#if !defined(__cpp_impl_coroutine)
+#error "AsyncCalculator.h uses coroutines, compile with --std=c++20"
+#endif
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include "Calculator.h"
+#include "TaskScheduler.h"
+
+#define ASYNC_MAX_BATCH_SIZE 1024
+// The cache of compiled expressions is cleared when it grows beyond this size
+#define ASYNC_CACHE_SIZE 4096
+// The identifiers interned by the wrapped Calculator are forgotten when there are more than this many
+#define ASYNC_SYMBOL_TABLE_SIZE 16384
+
+template <class T>
+class Task {
+public:
+    struct promise_type {
+        T value;
+        exception_ptr error;
+        coroutine_handle<> continuation;
+
+        // Resumes the awaiting coroutine once the task finishes
+        struct FinalAwaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+            coroutine_handle<> await_suspend(coroutine_handle<promise_type> handle) noexcept {
+                return handle.promise().continuation;
+            }
+            void await_resume() noexcept {;}
+        };
+
+        Task get_return_object() {
+            return Task(coroutine_handle<promise_type>::from_promise(*this));
+        }
+        suspend_always initial_suspend() noexcept {
+            return {};
+        }
+        FinalAwaiter final_suspend() noexcept {
+            return {};
+        }
+        void return_value(T _value) {
+            value = move(_value);
+        }
+        void unhandled_exception() {
+            error = current_exception();
+        }
+    };
+private:
+    coroutine_handle<promise_type> handle;
+public:
+    explicit Task (coroutine_handle<promise_type> _handle) : handle(_handle) {;}
+    Task (Task && other) : handle(exchange(other.handle, nullptr)) {;}
+    Task (const Task &) = delete;
+
+    ~Task () {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool await_ready() const {
+        return false;
+    }
+
+    coroutine_handle<> await_suspend(coroutine_handle<> awaiting) {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    T await_resume() {
+        if (handle.promise().error) {
+            rethrow_exception(handle.promise().error);
+        }
+        return move(handle.promise().value);
+    }
+};
+
+// A coroutine which starts right away and is destroyed when it finishes, nothing awaits it
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() {
+            return {};
+        }
+        suspend_never initial_suspend() noexcept {
+            return {};
+        }
+        suspend_never final_suspend() noexcept {
+            return {};
+        }
+        void return_void() {;}
+        void unhandled_exception() {
+            terminate();
+        }
+    };
+};
+
+// Resumes the awaiting coroutine in a task of the scheduler
+struct ScheduleAwaiter {
+    TaskScheduler & scheduler;
+
+    bool await_ready() const {
+        return false;
+    }
+    void await_suspend(coroutine_handle<> handle) {
+        scheduler.submit([handle] { handle.resume(); });
+    }
+    void await_resume() const {;}
+};
+
+// Runs a task to completion, the calling thread runs tasks of the scheduler meanwhile
+template <class T>
+T sync_wait(Task<T> task, TaskScheduler & scheduler) {
+    atomic<bool> done(false);
+    T result;
+    exception_ptr error;
+
+    auto run = [&]() -> Detached {
+        try {
+            result = co_await move(task);
+        } catch (...) {
+            error = current_exception();
+        }
+        done.store(true, memory_order_release);
+    };
+    run();
+
+    scheduler.wait_until([&done] { return done.load(memory_order_acquire); });
+    if (error) {
+        rethrow_exception(error);
+    }
+    return result;
+}
+
+class AsyncCalculator {
+private:
+    class EvaluationAwaiter;
+
+    struct CachedExpression {
+        shared_ptr<CompiledExpression> compiled;
+        // Error of the compilation when compiled is null
+        string error;
+
+        mutex lock;
+        deque<EvaluationAwaiter*> pending;
+        // Whether a flush task is deferred or running
+        bool flushing = false;
+    };
+
+    // Suspends a request until the batch containing it is evaluated
+    class EvaluationAwaiter {
+    public:
+        AsyncCalculator & owner;
+        shared_ptr<CachedExpression> expression;
+        vector<value_type> values;
+
+        value_type result;
+        exception_ptr error;
+        coroutine_handle<> continuation;
+
+        EvaluationAwaiter (AsyncCalculator & _owner, shared_ptr<CachedExpression> _expression, vector<value_type> _values) :
+                owner(_owner), expression(move(_expression)), values(move(_values)), result(0) {;}
+
+        bool await_ready() const {
+            return false;
+        }
+
+        // The request may be resumed by another thread before enqueue returns, it is not used afterwards
+        void await_suspend(coroutine_handle<> handle) {
+            continuation = handle;
+            owner.enqueue(expression, this);
+        }
+
+        value_type await_resume() {
+            if (error) {
+                rethrow_exception(error);
+            }
+            return result;
+        }
+    };
+
+    TaskScheduler & scheduler;
+    int max_batch_size;
+
+    // Calculator is not thread safe, it is only used under its lock
+    Calculator calculator;
+    mutex calculator_lock;
+
+    unordered_map<string, shared_ptr<CachedExpression>> cache;
+    mutex cache_lock;
+
+    atomic<long long> nr_batches;
+    atomic<long long> nr_batched_requests;
+
+    // Forgets the identifiers of the wrapped Calculator once there are too many of them, so that a long-lived
+    // service doesn't keep every name it was ever sent. It must be called under the lock of the calculator.
+    void limit_symbols();
+
+    // Returns the cached compilation of an expression, compiling it on first use
+    shared_ptr<CachedExpression> parse(const string & expression);
+
+    void enqueue(shared_ptr<CachedExpression> expression, EvaluationAwaiter * request);
+
+    // Evaluates the next batch of requests of an expression and resumes them
+    void flush(shared_ptr<CachedExpression> expression);
+
+    static void evaluate(CompiledExpression & compiled, const vector<EvaluationAwaiter*> & batch);
+public:
+    explicit AsyncCalculator (TaskScheduler & _scheduler = TaskScheduler::instance(),
+                              int _max_batch_size = ASYNC_MAX_BATCH_SIZE);
+
+    // Evaluates an expression with the same result as Calculator::eval
+    // Expressions without variables are evaluated in batches, the other ones by eval under the lock of the calculator
+    Task<string> eval_async(string expression);
+
+    // Evaluates an expression without equal sign given the values of its variables, in order of appearance
+    // example: For "x * 2 + sin(y)" and {1.5, 0.25} it returns 3.2474
+    Task<value_type> eval_async(string expression, vector<value_type> values);
+
+    // Average number of requests evaluated together
+    double average_batch_size() const {
+        return nr_batches ? (double)nr_batched_requests / nr_batches : 0;
+    }
+
+    static void test();
+
+    // Load generator sending bursts of requests, prints the latency percentiles
+    static void benchmark();
+};
+
+//////////////////////////////////////////////////////////////
+
+AsyncCalculator::AsyncCalculator(TaskScheduler & _scheduler, int _max_batch_size) :
+        scheduler(_scheduler), max_batch_size(max(_max_batch_size, 1)), nr_batches(0), nr_batched_requests(0) {;}
+
+void AsyncCalculator::limit_symbols() {
+    if (calculator.nr_symbols() > ASYNC_SYMBOL_TABLE_SIZE) {
+        calculator.clear_symbols();
+    }
+}
+
+shared_ptr<AsyncCalculator::CachedExpression> AsyncCalculator::parse(const string & expression) {
+    {
+        lock_guard<mutex> guard(cache_lock);
+        auto found = cache.find(expression);
+        if (found != cache.end()) {
+            return found->second;
+        }
+    }
+
+    auto parsed = make_shared<CachedExpression>();
+    {
+        lock_guard<mutex> guard(calculator_lock);
+        try {
+            parsed->compiled = calculator.compile(expression);
+        } catch (string error) {
+            parsed->error = error;
+        } catch (exception & error) {
+            // A request must never take the service down, whatever the expression
+            parsed->error = string("Error in compilation: ") + error.what();
+        }
+        limit_symbols();
+    }
+
+    if (parsed->compiled) {
+        auto compiled = parsed->compiled;
+        scheduler.submit([compiled] { compiled->optimize(); });
+    }
+
+    // The evicted expressions are destroyed once the lock is released: their destructor waits for their promotion
+    // by running scheduler tasks, which may parse expressions again
+    unordered_map<string, shared_ptr<CachedExpression>> evicted;
+    lock_guard<mutex> guard(cache_lock);
+    if (cache.size() >= ASYNC_CACHE_SIZE) {
+        evicted.swap(cache);
+    }
+    // Another request may have parsed the same expression meanwhile
+    return cache.emplace(expression, parsed).first->second;
+}
+
+void AsyncCalculator::enqueue(shared_ptr<CachedExpression> expression, EvaluationAwaiter * request) {
+    lock_guard<mutex> guard(expression->lock);
+    expression->pending.push_back(request);
+    if (!expression->flushing) {
+        expression->flushing = true;
+        scheduler.defer([this, expression] { flush(expression); });
+    }
+}
+
+void AsyncCalculator::flush(shared_ptr<CachedExpression> expression) {
+    vector<EvaluationAwaiter*> batch;
+    {
+        lock_guard<mutex> guard(expression->lock);
+        auto & pending = expression->pending;
+        int size = min((int)pending.size(), max_batch_size);
+        batch.assign(pending.begin(), pending.begin() + size);
+        pending.erase(pending.begin(), pending.begin() + size);
+    }
+
+    evaluate(*expression->compiled, batch);
+    ++nr_batches;
+    nr_batched_requests += batch.size();
+
+    {
+        lock_guard<mutex> guard(expression->lock);
+        // The requests which arrived during the evaluation form the next batch
+        if (expression->pending.empty()) {
+            expression->flushing = false;
+        } else {
+            scheduler.defer([this, expression] { flush(expression); });
+        }
+    }
+
+    for (auto request : batch) {
+        request->continuation.resume();
+    }
+}
+
+void AsyncCalculator::evaluate(CompiledExpression & compiled, const vector<EvaluationAwaiter*> & batch) {
+    int nr_arguments = compiled.get_arguments().size();
+
+    vector<EvaluationAwaiter*> rows;
+    for (auto request : batch) {
+        if ((int)request->values.size() == nr_arguments) {
+            rows.push_back(request);
+        } else {
+            request->error = make_exception_ptr(string("Expected " + to_string(nr_arguments) + " values for the variables"));
+        }
+    }
+
+    if (rows.empty()) {
+        return;
+    }
+
+    try {
+        if (nr_arguments == 0) {
+            // All the requests of a constant expression share its value
+            value_type value = compiled.evaluate({});
+            for (auto request : rows)
+                request->result = value;
+            return;
+        }
+
+        int n = rows.size();
+        vector<vector<value_type>> columns(nr_arguments, vector<value_type>(n));
+        vector<const value_type *> column_pointers;
+        for (int k = 0; k < nr_arguments; ++k) {
+            for (int i = 0; i < n; ++i)
+                columns[k][i] = rows[i]->values[k];
+            column_pointers.push_back(columns[k].data());
+        }
+
+        vector<value_type> results(n);
+        compiled.evaluate_batch(column_pointers, results.data(), n);
+        for (int i = 0; i < n; ++i)
+            rows[i]->result = results[i];
+    } catch (string) {
+        // Some rows failed, they are evaluated one at a time so that only their requests get the error
+        for (auto request : rows) {
+            try {
+                request->result = compiled.evaluate(request->values);
+            } catch (string error) {
+                request->error = make_exception_ptr(error);
+            }
+        }
+    }
+}
+
+Task<string> AsyncCalculator::eval_async(string expression) {
+    co_await ScheduleAwaiter{scheduler};
+    auto parsed = parse(expression);
+
+    if (parsed->compiled && parsed->compiled->get_arguments().empty()) {
+        bool failed = false;
+        value_type result = 0;
+        try {
+            result = co_await EvaluationAwaiter(*this, parsed, {});
+        } catch (string) {
+            failed = true;
+        }
+
+        if (!failed) {
+            stringstream ss;
+            ss << result;
+            co_return ss.str();
+        }
+    }
+
+    // Equations, systems and errors, whose messages come from eval
+    lock_guard<mutex> guard(calculator_lock);
+    string result = calculator.eval(expression);
+    limit_symbols();
+    co_return result;
+}
+
+Task<value_type> AsyncCalculator::eval_async(string expression, vector<value_type> values) {
+    co_await ScheduleAwaiter{scheduler};
+    auto parsed = parse(expression);
+
+    if (!parsed->compiled) {
+        throw parsed->error;
+    }
+
+    co_return co_await EvaluationAwaiter(*this, parsed, move(values));
+}
+
+void AsyncCalculator::test() {
+    // Without worker threads every task runs in sync_wait and wait_until, on this thread
+    TaskScheduler scheduler(0);
+    AsyncCalculator calculator(scheduler);
+    Calculator reference;
+
+    for (string expression : {"4 + 9", "sin(0.5) * 2 - pow(2, 0.5)", "if(1 < 2, 3, 1 / 0)", "x + 5 = 11", "1 / 0",
+                              "1 $ 2", "2a + 3b = 7; a - b = 1", "x", "max(1)"}) {
+        assert (sync_wait(calculator.eval_async(expression), scheduler) == reference.eval(expression));
+    }
+
+    assert (sync_wait(calculator.eval_async("x * 2 + y", {1.5, 1}), scheduler) == 4);
+
+    auto error_of = [&](string expression, vector<value_type> values) {
+        try {
+            sync_wait(calculator.eval_async(expression, values), scheduler);
+        } catch (string error) {
+            return error;
+        }
+        return string();
+    };
+    assert (error_of("1 / x", {0}) == "Can't divide polynomial by 0");
+    assert (error_of("x * y", {1}) == "Expected 2 values for the variables");
+    assert (error_of("x = 1", {1}) == "Compiled expressions can't contain an equal sign");
+
+    // Numbers out of the range of double are reported, a detached request gets the error instead of terminating
+    string huge_number = "1" + string(400, '0') + " + 1", tiny_number = "0." + string(400, '0') + "1";
+    string out_of_range = "Error in tokenizer: Invalid floating number: out of the range of double\n";
+    assert (sync_wait(calculator.eval_async(huge_number), scheduler) == out_of_range);
+    assert (error_of(tiny_number, {}) == out_of_range);
+    string detached_error;
+    auto failing_request = [&]() -> Detached {
+        vector<value_type> values;
+        try {
+            co_await calculator.eval_async(tiny_number + " * x", move(values));
+        } catch (string error) {
+            detached_error = error;
+        }
+    };
+    failing_request();
+    scheduler.wait_until([&detached_error] { return !detached_error.empty(); });
+    assert (detached_error == out_of_range);
+
+    // Concurrent requests on the same expression are coalesced into batches,
+    // a failing row only fails its own request
+    int n = 5000;
+    vector<value_type> results(n);
+    vector<string> errors(n);
+    atomic<int> remaining(n);
+    auto request = [&](int i) -> Detached {
+        // The values are built before co_await, gcc can't keep an initializer list alive across it
+        vector<value_type> values = {value_type(i % 100)};
+        try {
+            results[i] = co_await calculator.eval_async("log(x) * 2", move(values));
+        } catch (string error) {
+            errors[i] = error;
+        }
+        --remaining;
+    };
+
+    for (int i = 0; i < n; ++i) {
+        request(i);
+    }
+    scheduler.wait_until([&remaining] { return remaining == 0; });
+
+    for (int i = 0; i < n; ++i) {
+        assert (i % 100 == 0 ? errors[i] == "Can't take logarithm a number less than or equal to 0" : results[i] == log(i % 100) * 2);
+    }
+    assert (calculator.average_batch_size() > 100);
+
+    // Filling the cache evicts the compiled expressions, the requests still get their own results
+    for (int i = 0; i <= ASYNC_CACHE_SIZE; ++i) {
+        assert (sync_wait(calculator.eval_async("x + " + to_string(i), {1}), scheduler) == i + 1);
+    }
+    assert (sync_wait(calculator.eval_async("x + 7", {2}), scheduler) == 9);
+
+    // The symbol table is bounded however many distinct identifiers are sent
+    for (int i = 0; i <= ASYNC_SYMBOL_TABLE_SIZE; ++i) {
+        string name = "name";
+        for (int digits = i; digits; digits /= 26) {
+            name += char('a' + digits % 26);
+        }
+        sync_wait(calculator.eval_async(name + " = 1"), scheduler);
+    }
+    assert (calculator.calculator.nr_symbols() <= ASYNC_SYMBOL_TABLE_SIZE);
+    assert (sync_wait(calculator.eval_async("2 * name = 1"), scheduler) == "0.5");
+
+    // The default scheduler runs the requests even if the caller blocks without running tasks
+    static AsyncCalculator shared;
+    promise<string> shared_result;
+    auto future_result = shared_result.get_future();
+    auto blocking_request = [&]() -> Detached {
+        shared_result.set_value(co_await shared.eval_async("1 + 2"));
+    };
+    blocking_request();
+    assert (future_result.get() == "3");
+}
+
+void AsyncCalculator::benchmark() {
+    const char * expressions[] = {"x * 2 + sin(y)", "pow(x, 2) + y * y", "if(x < y, x, y) + 1", "log(x + 1) * y"};
+    // Bursts spaced so that the average load stays below the throughput of the unbatched evaluation
+    int nr_bursts = 50, burst_size = 2000;
+
+    cout << "\nBursts of " << burst_size << " requests over 4 expressions, latency in microseconds\n";
+    cout << setw(10) << "batch" << setw(14) << "requests/s" << setw(10) << "p50" << setw(10) << "p99"
+         << setw(10) << "p99.9" << setw(10) << "max" << setw(14) << "average batch" << "\n";
+
+    for (int max_batch_size : {1, ASYNC_MAX_BATCH_SIZE}) {
+        TaskScheduler scheduler(max(hardware_threads() - 1, 1));
+        AsyncCalculator calculator(scheduler, max_batch_size);
+
+        vector<double> latencies(nr_bursts * burst_size);
+        atomic<int> remaining(latencies.size());
+        auto request = [&](int i, chrono::steady_clock::time_point start) -> Detached {
+            vector<value_type> values = {value_type(i % 100), 0.5};
+            co_await calculator.eval_async(expressions[i % 4], move(values));
+            latencies[i] = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+            --remaining;
+        };
+
+        auto start = chrono::steady_clock::now();
+        for (int burst = 0; burst < nr_bursts; ++burst) {
+            for (int k = 0; k < burst_size; ++k) {
+                request(burst * burst_size + k, chrono::steady_clock::now());
+            }
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        scheduler.wait_until([&remaining] { return remaining == 0; });
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+        sort(latencies.begin(), latencies.end());
+        auto percentile = [&latencies](double p) {
+            return latencies[min((size_t)(p * latencies.size()), latencies.size() - 1)];
+        };
+
+        cout << fixed << setprecision(1) << setw(10) << max_batch_size << setw(14) << latencies.size() / elapsed.count()
+             << setw(10) << percentile(0.5) << setw(10) << percentile(0.99) << setw(10) << percentile(0.999)
+             << setw(10) << latencies.back() << setw(14) << calculator.average_batch_size() << "\n";
+        cout.unsetf(ios::fixed);
+    }
+}
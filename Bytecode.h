@@ -0,0 +1,232 @@
+/*
+Flat bytecode for the RPN program of an expression
+
+Compiling to bytecode folds every subexpression which does not depend on a variable into a constant.
+The arithmetic operators are executed inline, the other functions are called through Function::apply_value.
+The bytecode operates on constants only, variables are read from an array of arguments.
+
+if(condition, a, b) is compiled to "condition JUMP_IF_FALSE a JUMP b", so the branch which is not taken
+is skipped. When the condition is a constant, only the branch it chooses is compiled.
+*/
+
+#pragma once
+
+#include "Node.h"
+
+// Stack size up to which running the bytecode does not allocate memory
+#define BYTECODE_INLINE_STACK_SIZE 64
+
+enum OpCode {OP_CONSTANT, OP_ARGUMENT, OP_ADD, OP_SUBSTRACT, OP_MULTIPLY, OP_DIVIDE, OP_NEGATE, OP_CALL,
+             OP_JUMP_IF_FALSE, OP_JUMP};
+
+struct Instruction {
+    OpCode opcode;
+    // Index of the argument for OP_ARGUMENT, of the target instruction for the jumps
+    int index;
+    // Value for OP_CONSTANT
+    value_type constant;
+    // Function for OP_CALL and OP_DIVIDE
+    const Function * function;
+};
+
+class Bytecode {
+private:
+    vector<Instruction> code;
+    int stack_size;
+
+    static OpCode get_opcode(int symbol);
+
+    // Appends the instructions of a program which runs with depth elements on the stack
+    // Returns whether the program was folded into a constant
+    bool append(const Program & program, int depth);
+public:
+    Bytecode () : stack_size(0) {;}
+
+    // Compiles a program whose scalars are constants or variables and whose other nodes are functions
+    // The functions are referenced, not copied, so the program must outlive the bytecode
+    static Bytecode compile(const Program & program);
+
+    value_type run(const value_type * arguments) const;
+
+    int size() const {
+        return code.size();
+    }
+};
+
+//////////////////////////////////////////////////////////////
+
+OpCode Bytecode::get_opcode(int symbol) {
+    if (symbol == SYMBOL_ADD)
+        return OP_ADD;
+    else if (symbol == SYMBOL_SUBSTRACT)
+        return OP_SUBSTRACT;
+    else if (symbol == SYMBOL_MULTIPLY)
+        return OP_MULTIPLY;
+    else if (symbol == SYMBOL_DIVIDE)
+        return OP_DIVIDE;
+    else if (symbol == SYMBOL_NEGATE)
+        return OP_NEGATE;
+    else
+        return OP_CALL;
+}
+
+Bytecode Bytecode::compile(const Program & program) {
+    Bytecode bytecode;
+    bytecode.append(program, 0);
+    return bytecode;
+}
+
+bool Bytecode::append(const Program & program, int depth) {
+    // For every element of the stack: the position of its first instruction and whether it is a constant
+    vector<int> starts;
+    vector<bool> is_constant;
+
+    for (const auto & node : program) {
+        Instruction instruction = {OP_CONSTANT, 0, 0, NULL};
+
+        if (node->get_type() == NODE_SCALAR) {
+            Scalar * current_scalar = dynamic_cast<Scalar*>(node.get());
+            if (current_scalar->is_variable()) {
+                instruction.opcode = OP_ARGUMENT;
+                instruction.index = current_scalar->get_variable_index();
+            } else {
+                instruction.constant = current_scalar->get_constant();
+            }
+            starts.push_back(code.size());
+            is_constant.push_back(!current_scalar->is_variable());
+            code.push_back(instruction);
+        } else if (node->get_type() == NODE_FUNCTION) {
+            const Function * current_function = dynamic_cast<Function*>(node.get());
+            int arity = current_function->get_arity();
+            if ((int)starts.size() < arity) {
+                throw string("Insufficient number of operands for " + current_function->get_identifier());
+            }
+
+            int first_operand = starts.size() - arity;
+            int start = starts[first_operand];
+            bool constant_operands = true;
+            for (int k = first_operand; k < (int)starts.size(); ++k)
+                constant_operands = constant_operands && is_constant[k];
+
+            instruction.opcode = get_opcode(current_function->get_symbol());
+            instruction.function = current_function;
+
+            if (constant_operands) {
+                // The operands are the last instructions, all of them OP_CONSTANT
+                vector<value_type> operands;
+                for (int k = first_operand; k < (int)starts.size(); ++k)
+                    operands.push_back(code[starts[k]].constant);
+
+                try {
+                    instruction.constant = current_function->apply_value(operands.data());
+                    instruction.opcode = OP_CONSTANT;
+                    instruction.function = NULL;
+                    code.resize(start);
+                } catch (string error) {
+                    // Not folded, the error is reported when the bytecode runs
+                    constant_operands = false;
+                }
+            }
+
+            starts.resize(first_operand);
+            is_constant.resize(first_operand);
+            starts.push_back(start);
+            is_constant.push_back(constant_operands);
+            code.push_back(instruction);
+        } else if (node->get_type() == NODE_CONDITIONAL) {
+            const FunctionIf * conditional = dynamic_cast<const FunctionIf*>(node.get());
+            int start = code.size();
+            int branch_depth = depth + starts.size();
+            bool constant_result = append(conditional->get_argument(0), branch_depth);
+
+            if (constant_result) {
+                bool condition = code.back().constant != 0;
+                code.resize(start);
+                constant_result = append(conditional->get_argument(condition ? 1 : 2), branch_depth);
+            } else {
+                int jump_if_false = code.size();
+                code.push_back(instruction);
+                code[jump_if_false].opcode = OP_JUMP_IF_FALSE;
+                append(conditional->get_argument(1), branch_depth);
+
+                int jump = code.size();
+                code.push_back(instruction);
+                code[jump].opcode = OP_JUMP;
+                code[jump_if_false].index = code.size();
+                append(conditional->get_argument(2), branch_depth);
+                code[jump].index = code.size();
+            }
+
+            starts.push_back(start);
+            is_constant.push_back(constant_result);
+        } else {
+            throw string("Can't compile columns and aggregate functions to bytecode");
+        }
+
+        stack_size = max(stack_size, depth + (int)starts.size());
+    }
+
+    if (starts.size() != 1) {
+        throw string(starts.empty() ? "Insufficient scalars left" : "Too many scalars left");
+    }
+
+    return is_constant[0];
+}
+
+value_type Bytecode::run(const value_type * arguments) const {
+    value_type inline_stack[BYTECODE_INLINE_STACK_SIZE];
+    vector<value_type> heap_stack;
+    value_type * stack = inline_stack;
+    if (stack_size > BYTECODE_INLINE_STACK_SIZE) {
+        heap_stack.resize(stack_size);
+        stack = heap_stack.data();
+    }
+
+    // Index of the first free element of the stack
+    int top = 0;
+    stack[0] = 0;
+    for (int position = 0; position < (int)code.size(); ++position) {
+        const Instruction & instruction = code[position];
+        switch (instruction.opcode) {
+        case OP_CONSTANT:
+            stack[top++] = instruction.constant;
+            break;
+        case OP_ARGUMENT:
+            stack[top++] = arguments[instruction.index];
+            break;
+        case OP_ADD:
+            --top;
+            stack[top - 1] += stack[top];
+            break;
+        case OP_SUBSTRACT:
+            --top;
+            stack[top - 1] -= stack[top];
+            break;
+        case OP_MULTIPLY:
+            --top;
+            stack[top - 1] *= stack[top];
+            break;
+        case OP_DIVIDE:
+            --top;
+            stack[top - 1] = instruction.function->apply_value(stack + top - 1);
+            break;
+        case OP_NEGATE:
+            stack[top - 1] = -stack[top - 1];
+            break;
+        case OP_CALL:
+            top -= instruction.function->get_arity() - 1;
+            stack[top - 1] = instruction.function->apply_value(stack + top - 1);
+            break;
+        case OP_JUMP_IF_FALSE:
+            if (stack[--top] == 0) {
+                position = instruction.index - 1;
+            }
+            break;
+        case OP_JUMP:
+            position = instruction.index - 1;
+            break;
+        }
+    }
+
+    return stack[0];
+}
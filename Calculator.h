@@ -1,41 +1,103 @@
+#pragma once
 
 #include "Node.h"
-
+#include "Lexer.h"
+#include "ShuntingYard.h"
+#include "LinearSystem.h"
+#include "Reduction.h"
+#include "CompiledExpression.h"
+#include "ParallelEvaluator.h"
+#include "IntervalSearch.h"
+
+#include <chrono>
+#include <iomanip>
+#include <map>
 #include <sstream>
 
-#define LEFT_PARANTHESES '('
-#define RIGHT_PARANTHESES ')'
-#define COMMA ','
-#define EQUAL_SIGN '='
-#define MINUS_SIGN '-'
-#define VARIABLE 'x'
+#define SEMICOLON ';'
 
 class Calculator {
 private:
     bool verbose;
 
-    // Parses a floating point number from the beginning of a string
-    string parse_number(const string & expression);
+    // Receives the lines of the verbose output
+    function<void(const string &)> log_sink;
+
+    // Accuracy tier of the mathematical functions of the compiled expressions
+    MathAccuracy accuracy;
+
+    // Minimum cost of the subtrees evaluated as separate tasks, 0 if the parallel evaluation is disabled
+    long long parallel_min_task_cost;
+
+    // Identifiers of all the expressions evaluated so far
+    SymbolTable symbols;
+
+    // Symbols of the variables of the current expression, in order of appearance
+    vector<int> variables;
+
+    // Returns the index of a variable, registering it on first use
+    int get_variable_index(int symbol);
 
-    // Gets the next token from the expression 
-    Token get_token(string & expression, bool expect_operator);
+    vector<string> get_variable_names() const;
 
-    // Tokenizes the given expression
+    // Variables bound to columns of values and to constants, by symbol
+    map<int, vector<value_type>> columns;
+    map<int, value_type> constants;
+
+    bool is_bound(int symbol) const;
+
+    // Names of tokens and nodes for the verbose output, numbers are named by their value
+    string get_name(const Token & token) const;
+    string get_name(const AbstractNode * node) const;
+
+    // Tokenizes the given expression, errors are thrown
     // example: For "4 +7=10" it returns {4,whitespace,+,7,=,10}
 
     vector<Token> tokenize_expression(const string & expression);
 
+    // Builds the node of a token in reverse polish notation
+    unique_ptr<AbstractNode> make_node(const Token & token);
+
     // Build the reverse polish notation of the expression using the Shunting-yard algorithm
     vector<unique_ptr<AbstractNode>> build_reverse_polish_notation(const vector<Token> & tokens);
 
+    // Moves the arguments of every lazy function (aggregates and if) out of the output queue and into the function
+    // example: For "x 2 pow sum 3 +" the output queue becomes "sum 3 +", sum having the argument "x 2 pow"
+    void capture_lazy_arguments(vector<unique_ptr<AbstractNode>> & output_queue);
+
+    // Checks that the variables of the arguments of an aggregate are bound
+    void check_bound_variables(const Program & program);
+
     // Computes the result polynomial from an expression in reverse polish notation
     scalar process_reverse_polish_notation(const vector<unique_ptr<AbstractNode>> & output_queue);
 
+    // Evaluates the next node of an expression in reverse polish notation on the stack of intermediate results
+    void process_node(AbstractNode * node, stack<scalar> & buffer);
+
+    // Pops the result of an expression in reverse polish notation, the only scalar left on the stack
+    scalar pop_result(stack<scalar> & buffer);
+
     // Evaluates an expression support 2 modes:
     // 1. Standard evaluation of an expression consisting only of constants
     // 2. Solving for the root of an expression consisting of 
 
-    value_type compute_constant_result(const string & expression);
+    value_type compute_constant_result(const vector<Token> & tokens);
+
+    // Evaluates an expression or an equation in one variable read from a stream, see eval_stream
+    value_type compute_streaming_result(istream & input);
+
+    // Checks if the tokens of an expression form an equation in more than one variable, a system of linear equations
+    bool is_linear_system(const vector<Token> & tokens);
+
+    // Tokenizes the equations of a system separated by semicolons, the empty ones have no tokens
+    vector<vector<Token>> tokenize_system(const string & expression);
+
+    // Solves a system of linear equations given the tokens of every equation
+    // example: For "2a + 3b = 7; a - b = 1" it returns "a = 2, b = 1"
+    string solve_linear_system(const vector<vector<Token>> & equations);
+
+    // Builds the program of an expression or an equation in at most one variable, with its aggregates reduced
+    Program build_search_program(const string & expression);
 public:
     // Evaluates an expression support 2 modes:
     // 1. Standard evaluation of an expression consisting only of constants
@@ -43,9 +105,61 @@ public:
 
     string eval(const string & expression);
 
+    // Evaluates an expression or an equation in one variable read from a stream, in memory proportional
+    // to the nesting depth of the expression rather than its length. Systems of equations are not supported.
+    string eval_stream(istream & input);
+
+    // Compiles an expression without equal sign, its variables become the arguments of the compiled expression
+    // example: For "x * 2 + sin(y)" it returns an expression evaluated with the values of x and y
+    shared_ptr<CompiledExpression> compile(const string & expression);
+
+    // Compiles an expression with the given accuracy tier instead of the one of the calculator
+    shared_ptr<CompiledExpression> compile(const string & expression, MathAccuracy expression_accuracy);
+
+    // Encloses every root of an expression or an equation in one variable on [a, b] in intervals at most tolerance wide
+    // example: For "x * x = 2" on [-10, 10] it returns intervals around -1.41421 and 1.41421
+    RootEnclosures find_roots(const string & expression, value_type a, value_type b,
+                              value_type tolerance = INTERVAL_TOLERANCE);
+
+    // Encloses the maximum of an expression in one variable on [a, b] and the points where it is reached
+    ExtremumEnclosure find_maximum(const string & expression, value_type a, value_type b,
+                                   value_type tolerance = INTERVAL_EXTREMUM_TOLERANCE);
+
+    ExtremumEnclosure find_minimum(const string & expression, value_type a, value_type b,
+                                   value_type tolerance = INTERVAL_EXTREMUM_TOLERANCE);
+
+    void set_accuracy(MathAccuracy _accuracy);
+
+    // Sends the verbose output to a sink instead of the standard error, an empty sink disables it
+    void set_log_sink(function<void(const string &)> sink);
+
+    // Evaluates large expressions by scheduling their independent subtrees on the task scheduler
+    void set_parallel_evaluation(bool enabled, long long min_task_cost = PARALLEL_MIN_TASK_COST);
+
+    // Binds a variable to a column of values, which can be used in the aggregate functions sum, mean and dot
+    void bind(const string & name, vector<value_type> values);
+
+    // Binds a variable to a constant
+    void bind(const string & name, value_type value);
+
+    void clear_bindings();
+
+    // Forgets the identifiers of the expressions evaluated so far, except the names of the bound variables.
+    // Compiled expressions don't refer to the table, they stay valid.
+    void clear_symbols();
+
+    int nr_symbols() const {
+        return symbols.size();
+    }
+
     void test();
 
-    Calculator () {;}
+    // Prints the throughput of the mathematical kernels for every accuracy tier
+    void benchmark();
+
+    Calculator () : verbose(false), accuracy(ACCURACY_EXACT), parallel_min_task_cost(0) {;}
+
+    // The verbose output is written to the standard error
     Calculator (bool _verbose);
 }; 
 
@@ -53,247 +167,284 @@ public:
 
 Calculator::Calculator(bool _verbose) {
     verbose = _verbose;
+    accuracy = ACCURACY_EXACT;
+    parallel_min_task_cost = 0;
+    log_sink = [](const string & line) {
+        cerr << line << "\n";
+    };
 }
 
-string Calculator::parse_number(const string & expression) {
-    unsigned int j = 1;
-    int number_dots = 0;
-    while (j < expression.size()) {
-        if (isalpha(expression[j]) || expression[j] == LEFT_PARANTHESES) {
-            throw string("Invalid floating number: contains invalid characters");
-        } else if (!isdigit(expression[j]) && expression[j] != '.') {
-            break;
-        }
-
-        number_dots += expression[j] == '.';
-        ++j;
-    }
-
-    if (number_dots > 1) {
-        throw string("Invalid floating number: too many dots");
-    }
-
-    return expression.substr(0, j);
-}
-
-Token Calculator::get_token(string & expression, bool expect_operator) {
-    if (expression[0] == ' ' || expression[0] == '\t') {
-        // whitespace
-        expression.erase(0, 1);
-        return Token ("whitespace", TOKEN_WHITESPACE);
-    } else if (expression[0] == COMMA) {
-        // comma
-         expression.erase(0, 1);
-        return Token (string(1, COMMA), TOKEN_COMMA);
-    } else if (isdigit(expression[0])) {
-        // number
-        string identifier = parse_number (expression);
-        expression.erase(0, identifier.size());
-        return Token (identifier, TOKEN_NUMBER);
-    } else if (expression[0] == VARIABLE && !(expression.size() > 2 && isalpha(expression[1]))) {
-        // x variable
-        string identifier = string(1, expression[0]); 
-        expression.erase(0, 1);
-        return Token (identifier, TOKEN_VARIABLE);
-    } else if (isalpha(expression[0])) {
-        // function
-        unsigned int j = 1;
-        while (j < expression.size()) {
-            if (!isalpha(expression[j])) {
-                if (expression[j] != LEFT_PARANTHESES && expression[j] != ' ' && expression[j] != '\t') {
-                    throw string("Invalid function definition");
-                }
-                break;
-            }
-            ++j;
-        }
-
-        string identifier = expression.substr(0, j);
-        expression.erase(0, j);
-        return Token (identifier, TOKEN_FUNCTION);
-    } else if (expression[0] == LEFT_PARANTHESES) {
-        // (
-        string identifier = string(1, expression[0]); 
-        expression.erase(0, 1);
-        return Token (identifier, TOKEN_LEFT_PARANTHESES);
-    } else if (expression[0] == RIGHT_PARANTHESES) {
-        // )
-        string identifier = string(1, expression[0]);
-        expression.erase(0, 1);
-        return Token (identifier, TOKEN_RIGHT_PARANTHESES);
-    } else if (expression[0] == EQUAL_SIGN) {
-        // =
-        string identifier = string(1, expression[0]);
-        expression.erase(0, 1);
-        return Token (identifier, TOKEN_EQUAL_SIGN);
-    } else if (expression[0] == MINUS_SIGN && !expect_operator) {
-        // negation sign
-        string identifier = string("~");
-        expression.erase(0, 1);
-        return Token (identifier, TOKEN_OPERATOR);
-    } else {
-        // operator
-    
-        if (expression[0] == '+' || expression[0] == '-' || expression[0] == '*' || expression[0] == '/') {
-            auto identifier = string(1, expression[0]);
-            expression.erase(0, 1);
-            return Token (identifier, TOKEN_OPERATOR);
-        } else {
-            throw string("Invalid operator");
+void Calculator::set_accuracy(MathAccuracy _accuracy) {
+    accuracy = _accuracy;
+}
+
+void Calculator::set_log_sink(function<void(const string &)> sink) {
+    log_sink = move(sink);
+    verbose = bool(log_sink);
+}
+
+void Calculator::set_parallel_evaluation(bool enabled, long long min_task_cost) {
+    parallel_min_task_cost = enabled ? max(min_task_cost, 1LL) : 0;
+}
+
+void Calculator::bind(const string & name, vector<value_type> values) {
+    int symbol = symbols.intern(name);
+    constants.erase(symbol);
+    columns[symbol] = move(values);
+}
+
+void Calculator::bind(const string & name, value_type value) {
+    int symbol = symbols.intern(name);
+    columns.erase(symbol);
+    constants[symbol] = value;
+}
+
+void Calculator::clear_bindings() {
+    columns.clear();
+    constants.clear();
+}
+
+void Calculator::clear_symbols() {
+    SymbolTable bound_symbols;
+    map<int, vector<value_type>> bound_columns;
+    map<int, value_type> bound_constants;
+    for (auto & column : columns) {
+        bound_columns[bound_symbols.intern(symbols.name(column.first))] = move(column.second);
+    }
+    for (const auto & constant : constants) {
+        bound_constants[bound_symbols.intern(symbols.name(constant.first))] = constant.second;
+    }
+
+    symbols = move(bound_symbols);
+    columns = move(bound_columns);
+    constants = move(bound_constants);
+    variables.clear();
+}
+
+bool Calculator::is_bound(int symbol) const {
+    return columns.count(symbol) || constants.count(symbol);
+}
+
+int Calculator::get_variable_index(int symbol) {
+    for (unsigned int i = 0; i < variables.size(); ++i) {
+        if (variables[i] == symbol) {
+            return i;
         }
     }
+
+    variables.push_back(symbol);
+    return variables.size() - 1;
 }
 
-vector<Token> Calculator::tokenize_expression(const string & expression) {
-    auto remaining_expression = expression;
+vector<string> Calculator::get_variable_names() const {
+    vector<string> names;
+    for (int symbol : variables) {
+        names.push_back(symbols.name(symbol));
+    }
+    return names;
+}
 
-    vector<Token> tokens;
+string Calculator::get_name(const Token & token) const {
+    if (token.token_type == TOKEN_WHITESPACE) {
+        return "whitespace";
+    } else if (token.token_type == TOKEN_COMMA) {
+        return string(1, COMMA);
+    } else if (token.token_type == TOKEN_LEFT_PARANTHESES) {
+        return string(1, LEFT_PARANTHESES);
+    } else if (token.token_type == TOKEN_RIGHT_PARANTHESES) {
+        return string(1, RIGHT_PARANTHESES);
+    } else if (token.token_type == TOKEN_EQUAL_SIGN) {
+        return string(1, EQUAL_SIGN);
+    } else if (token.token_type == TOKEN_NUMBER) {
+        stringstream ss;
+        ss << token.value;
+        return ss.str();
+    }
+    return symbols.name(token.symbol);
+}
 
-    bool expect_operator = false;
+string Calculator::get_name(const AbstractNode * node) const {
+    if (node->get_symbol() == NO_SYMBOL) {
+        stringstream ss;
+        ss << dynamic_cast<const Scalar*>(node)->get_constant();
+        return ss.str();
+    }
+    return symbols.name(node->get_symbol());
+}
 
-    while (remaining_expression.size() > 0) {
-        Token token;
+vector<Token> Calculator::tokenize_expression(const string & expression) {
+    istringstream input(expression);
+    Lexer lexer(input, symbols);
 
-        try {
-            token = get_token(remaining_expression, expect_operator);
-            tokens.push_back(token);
-        } catch(string error) {
-            cout << "Error: " + error << "\n";
-            exit(0);
-        }
+    vector<Token> tokens;
+    Token token;
 
-        if (token.token_type == TOKEN_RIGHT_PARANTHESES || token.token_type == TOKEN_NUMBER || token.token_type == TOKEN_VARIABLE) {
-            expect_operator = true;
-        } else if (token.token_type != TOKEN_WHITESPACE) {
-            expect_operator = false;
-        }
+    while (lexer.next(token)) {
+        tokens.push_back(token);
     }
 
     return tokens;
 }
 
+unique_ptr<AbstractNode> Calculator::make_node(const Token & token) {
+    if (token.token_type == TOKEN_NUMBER) {
+        return unique_ptr<AbstractNode>(new Scalar(token));
+    } else if (token.token_type == TOKEN_VARIABLE) {
+        if (columns.count(token.symbol)) {
+            return unique_ptr<AbstractNode>(new Column(token.symbol, columns[token.symbol]));
+        } else if (constants.count(token.symbol)) {
+            return unique_ptr<AbstractNode>(new Scalar(token.symbol, constants[token.symbol]));
+        } else {
+            return unique_ptr<AbstractNode>(new Scalar(token, get_variable_index(token.symbol)));
+        }
+    } else if (token.token_type == TOKEN_FUNCTION && !FunctionFactory::is_function(token.symbol)) {
+        throw string("Invalid mathematical function " + symbols.name(token.symbol));
+    } else {
+        return FunctionFactory::build(token, accuracy);
+    }
+}
+
 vector<unique_ptr<AbstractNode>> Calculator::build_reverse_polish_notation(const vector<Token> & tokens) {
     if (verbose) {
-        cerr << "Bulding reverse polish notation\n";
+        log_sink("Bulding reverse polish notation");
     }
 
     vector<unique_ptr<AbstractNode>> output_queue;
-    stack<Token> buffer;
+    ShuntingYard yard([&](const Token & token, bool) {
+        output_queue.push_back(make_node(token));
+    });
 
     for (const auto & token : tokens) {
         if (verbose) {
-            cerr << "Processing: " << token.identifier << " " << token.token_type << "\n";
+            log_sink("Processing: " + get_name(token) + " " + to_string(token.token_type));
         }
 
-        if (token.token_type == TOKEN_WHITESPACE) {
-            continue;
-        } else if (token.token_type == TOKEN_NUMBER) {
-            output_queue.push_back(unique_ptr<AbstractNode>(new Scalar(token)));
-        } else if (token.token_type == TOKEN_VARIABLE) {
-            output_queue.push_back(unique_ptr<AbstractNode>(new Scalar(token)));
-        } else if (token.token_type == TOKEN_OPERATOR) {
-            auto next_operator = FunctionFactory::build(token);
-            while (!buffer.empty() && buffer.top().token_type == TOKEN_OPERATOR) {
-                auto peek_operator = FunctionFactory::build(buffer.top());
-                if (peek_operator->get_precedence() >= next_operator->get_precedence()) {   
-                    output_queue.push_back(move(peek_operator));
-                    buffer.pop();
-                } else {
-                    break;
-                }
-            }
-            buffer.push(token);
-        } else if (token.token_type == TOKEN_FUNCTION) {
-            buffer.push(token);
-        } else if (token.token_type == TOKEN_COMMA) {
-            while (!buffer.empty() && buffer.top().token_type != TOKEN_LEFT_PARANTHESES) {
-                output_queue.push_back(FunctionFactory::build(buffer.top()));
-                buffer.pop();
-            }
-            if (buffer.empty()) {
-                throw string("Invalid function declaration: missing left parantheses");
-            }
-        } else if (token.token_type == TOKEN_LEFT_PARANTHESES) {
-            buffer.push(token);
-        } else if (token.token_type == TOKEN_RIGHT_PARANTHESES) {
-            while (!buffer.empty() && buffer.top().token_type != TOKEN_LEFT_PARANTHESES) {
-                output_queue.push_back(FunctionFactory::build(buffer.top()));
-                buffer.pop();
-            }
+        yard.push(token);
+    }
 
-            if (buffer.empty()) {
-                throw string("Invalid parantheses: missing left parantheses");
-            }
+    yard.finish();
 
-            buffer.pop();
+    capture_lazy_arguments(output_queue);
 
-            // TODO: IF FUNCTION POP ONTO OUTPUT
-            if (!buffer.empty() && buffer.top().token_type == TOKEN_FUNCTION) {
-                output_queue.push_back(FunctionFactory::build(buffer.top()));
-                buffer.pop();
-            }
-        } else {
-            throw string("Unknown token: " + token.identifier);
-        }
+    if (verbose) {
+        log_sink("Finished building Reverse Polish Notation");
     }
 
-    // Push the remaining operators onto the output_queue
-    while (!buffer.empty()) {
-        if (buffer.top().token_type == TOKEN_LEFT_PARANTHESES || buffer.top().token_type == TOKEN_RIGHT_PARANTHESES) {
-            throw string("Mismatched parantheses");
+    return output_queue;
+}
+
+void Calculator::capture_lazy_arguments(vector<unique_ptr<AbstractNode>> & output_queue) {
+    vector<unique_ptr<AbstractNode>> result;
+
+    for (auto & node : output_queue) {
+        if (node->get_type() == NODE_AGGREGATE || node->get_type() == NODE_CONDITIONAL) {
+            LazyFunction * lazy_function = dynamic_cast<LazyFunction*>(node.get());
+            vector<Program> arguments(lazy_function->get_arity());
+
+            // Every argument is the subtree ending right before the next one, the last argument comes first
+            for (int k = lazy_function->get_arity() - 1; k >= 0; --k) {
+                int begin = result.size();
+                int nr_missing = 1;
+                while (nr_missing > 0) {
+                    if (begin == 0) {
+                        throw string("Insufficient number of operands for " + lazy_function->get_identifier());
+                    }
+                    --begin;
+                    --nr_missing;
+                    if (result[begin]->get_type() == NODE_FUNCTION) {
+                        nr_missing += dynamic_cast<Function*>(result[begin].get())->get_arity();
+                    }
+                }
+
+                move(result.begin() + begin, result.end(), back_inserter(arguments[k]));
+                result.resize(begin);
+
+                if (node->get_type() == NODE_AGGREGATE) {
+                    check_bound_variables(arguments[k]);
+                }
+            }
+
+            lazy_function->set_arguments(move(arguments));
         }
-        output_queue.push_back(FunctionFactory::build(buffer.top()));
-        buffer.pop();
-    }
 
-    if (verbose) {
-        cerr << "Finished building Reverse Polish Notation\n";
+        result.push_back(move(node));
     }
 
-    return output_queue;
+    output_queue = move(result);
+}
+
+void Calculator::check_bound_variables(const Program & program) {
+    for (const auto & node : program) {
+        if (node->get_type() == NODE_SCALAR && dynamic_cast<Scalar*>(node.get())->is_variable()) {
+            // The arguments are evaluated over the rows of the columns, where unbound variables have no value
+            throw string("Variable " + symbols.name(node->get_symbol()) + " is not bound to a value");
+        } else if (node->get_type() == NODE_CONDITIONAL) {
+            LazyFunction * lazy_function = dynamic_cast<LazyFunction*>(node.get());
+            for (int k = 0; k < lazy_function->get_arity(); ++k)
+                check_bound_variables(lazy_function->get_argument(k));
+        }
+    }
 }
 
 scalar Calculator::process_reverse_polish_notation(const vector<unique_ptr<AbstractNode>> & output_queue) {
     if (verbose) {
-        cerr << "Process reverse polish notation\n";
+        log_sink("Process reverse polish notation");
     }
 
-    scalar result = scalar::Zero();
+    // Programs smaller than a task are evaluated sequentially
+    if (parallel_min_task_cost > 0 && (long long)output_queue.size() >= parallel_min_task_cost) {
+        return ParallelEvaluator(output_queue, symbols, parallel_min_task_cost, TaskScheduler::instance()).evaluate();
+    }
 
     stack<scalar> buffer;
 
     for (unsigned int i = 0; i < output_queue.size(); ++i) {
-        if (output_queue[i]->get_type() == NODE_SCALAR) {
-            Scalar * current_scalar = dynamic_cast<Scalar*>(output_queue[i].get());
-            buffer.push(current_scalar->get_value());
-        } else {
-            Function * current_function = dynamic_cast<Function*>(output_queue[i].get());
-            vector<scalar> operands;
-            for (int nr_operand = 0; nr_operand < current_function->get_arity(); ++nr_operand) {
-                if (buffer.empty()) {
-                    throw string("Insufficient number of operands for " + current_function->get_identifier());
-                }
-                operands.push_back(buffer.top());
-                buffer.pop();
-            }
-            
-            reverse(operands.begin(), operands.end());
-            
-            try {
-                scalar cur_result = current_function->apply(operands);
-                buffer.push(cur_result);
-            } catch (string error) {
-                cerr << error << "\n";
-                exit(0);
+        process_node(output_queue[i].get(), buffer);
+    }
+
+    return pop_result(buffer);
+}
+
+void Calculator::process_node(AbstractNode * node, stack<scalar> & buffer) {
+    if (node->get_type() == NODE_SCALAR) {
+        Scalar * current_scalar = dynamic_cast<Scalar*>(node);
+        buffer.push(current_scalar->get_value());
+    } else if (node->get_type() == NODE_COLUMN) {
+        throw string("Column " + symbols.name(node->get_symbol()) + " can only be used inside an aggregate function");
+    } else if (node->get_type() == NODE_AGGREGATE) {
+        AggregateFunction * current_aggregate = dynamic_cast<AggregateFunction*>(node);
+        buffer.push(scalar(current_aggregate->reduce()));
+    } else if (node->get_type() == NODE_CONDITIONAL) {
+        // Only the branch chosen by the condition is evaluated
+        FunctionIf * conditional = dynamic_cast<FunctionIf*>(node);
+        scalar condition = process_reverse_polish_notation(conditional->get_argument(0));
+        if (!condition.is_constant()) {
+            throw string("The condition of if can't depend on the variable");
+        }
+        buffer.push(process_reverse_polish_notation(conditional->get_argument(condition.get_0() != 0 ? 1 : 2)));
+    } else {
+        Function * current_function = dynamic_cast<Function*>(node);
+        vector<scalar> operands;
+        for (int nr_operand = 0; nr_operand < current_function->get_arity(); ++nr_operand) {
+            if (buffer.empty()) {
+                throw string("Insufficient number of operands for " + current_function->get_identifier());
             }
+            operands.push_back(buffer.top());
+            buffer.pop();
         }
+        
+        reverse(operands.begin(), operands.end());
+
+        buffer.push(current_function->apply(operands));
     }
+}
 
+scalar Calculator::pop_result(stack<scalar> & buffer) {
     if (buffer.empty()) {
         throw string("Insufficient scalars left");
     }
 
-    result = buffer.top();
+    scalar result = buffer.top();
     buffer.pop();
 
     if (!buffer.empty()) {
@@ -303,19 +454,13 @@ scalar Calculator::process_reverse_polish_notation(const vector<unique_ptr<Abstr
     return result;
 }
 
-value_type Calculator::compute_constant_result(const string & expression) {
-    // get tokens for the expression
-    vector<Token> tokens;
-    try {
-        tokens = tokenize_expression(expression);
-    } catch (string error) {
-        throw string("Error in tokenizer: " + error + "\n");
-    }
+value_type Calculator::compute_constant_result(const vector<Token> & tokens) {
+    variables.clear();
 
     if (verbose) {
-        cerr << "Tokenizer finished:" << "\n";    
+        log_sink("Tokenizer finished:");
         for (const auto & token : tokens)
-            cerr << "Token: " << token.identifier << " " << token.token_type << "\n";
+            log_sink("Token: " + get_name(token) + " " + to_string(token.token_type));
     }
 
     // Decide on the type of expression (compute value or solve for x)
@@ -325,7 +470,7 @@ value_type Calculator::compute_constant_result(const string & expression) {
 
     for (const auto & token : tokens) {
         nr_equal_signs += token.token_type == TOKEN_EQUAL_SIGN;
-        contains_variable |= token.token_type == TOKEN_VARIABLE;
+        contains_variable |= token.token_type == TOKEN_VARIABLE && !is_bound(token.symbol);
     }
 
     if (nr_equal_signs > 1) {
@@ -337,14 +482,6 @@ value_type Calculator::compute_constant_result(const string & expression) {
         throw string("Expression must contain both a variable and equal sign or neither");
     }
 
-    // Change equal sign to minus and proceed as before
-    for (unsigned int i = 0; i < tokens.size(); ++i) {
-        if (tokens[i].token_type == TOKEN_EQUAL_SIGN) {
-            tokens[i].token_type = TOKEN_OPERATOR;
-            tokens[i].identifier = "-";
-        }
-    }
-
     bool is_equation = contains_variable;
 
     vector<unique_ptr<AbstractNode>> output_queue;
@@ -353,10 +490,11 @@ value_type Calculator::compute_constant_result(const string & expression) {
         output_queue = build_reverse_polish_notation(tokens);
 
         if (verbose) {
+            string line;
             for (unsigned int i = 0; i < output_queue.size(); ++i) {
-                cerr << output_queue[i]->get_identifier() << " ";
+                line += get_name(output_queue[i].get()) + " ";
             }
-            cerr << "\n";
+            log_sink(line);
         }
     } catch (string error) {
         throw string("Error in building reverse polish notation: " + error);
@@ -376,11 +514,12 @@ value_type Calculator::compute_constant_result(const string & expression) {
         final_result = result.get_0();
     } else {
         if (verbose) {
-            cerr << "Final polynomial: ";
+            stringstream line;
+            line << "Final polynomial: ";
             auto coeff = result.get_coeff();
             for (unsigned int i = 0; i < coeff.size(); ++i)
-                cerr << coeff[i] << " ";
-            cerr << "\n";
+                line << coeff[i] << " ";
+            log_sink(line.str());
         }
         try {
             final_result = result.solve_degree_1();
@@ -392,9 +531,209 @@ value_type Calculator::compute_constant_result(const string & expression) {
     return final_result;
 }
 
+value_type Calculator::compute_streaming_result(istream & input) {
+    variables.clear();
+
+    Lexer lexer(input, symbols);
+
+    // Nodes of the outermost lazy function being parsed, kept until its arguments are complete
+    Program lazy_nodes;
+    // Nodes ready to be evaluated
+    Program ready_nodes;
+
+    ShuntingYard yard([&](const Token & token, bool inside_lazy_function) {
+        auto node = make_node(token);
+        bool is_lazy = node->get_type() == NODE_AGGREGATE || node->get_type() == NODE_CONDITIONAL;
+        if (!inside_lazy_function && !is_lazy) {
+            ready_nodes.push_back(move(node));
+            return;
+        }
+
+        lazy_nodes.push_back(move(node));
+        if (!inside_lazy_function) {
+            capture_lazy_arguments(lazy_nodes);
+            move(lazy_nodes.begin(), lazy_nodes.end(), back_inserter(ready_nodes));
+            lazy_nodes.clear();
+        }
+    });
+
+    stack<scalar> buffer;
+
+    auto process_ready_nodes = [&]() {
+        try {
+            for (auto & node : ready_nodes) {
+                process_node(node.get(), buffer);
+            }
+        } catch (string error) {
+            throw string("Error in processing reverse polish notation: " + error);
+        }
+        ready_nodes.clear();
+    };
+
+    int nr_equal_signs = 0;
+    bool contains_variable = false;
+
+    Token token;
+    while (true) {
+        try {
+            if (!lexer.next(token)) {
+                break;
+            }
+        } catch (string error) {
+            throw string("Error in tokenizer: " + error + "\n");
+        }
+
+        if (token.token_type == TOKEN_EQUAL_SIGN && ++nr_equal_signs > 1) {
+            throw string("Expression contains too many equal signs");
+        }
+        contains_variable |= token.token_type == TOKEN_VARIABLE && !is_bound(token.symbol);
+
+        try {
+            yard.push(token);
+        } catch (string error) {
+            throw string("Error in building reverse polish notation: " + error);
+        }
+
+        process_ready_nodes();
+    }
+
+    if (contains_variable != (nr_equal_signs > 0)) {
+        throw string("Expression must contain both a variable and equal sign or neither");
+    }
+
+    try {
+        yard.finish();
+    } catch (string error) {
+        throw string("Error in building reverse polish notation: " + error);
+    }
+
+    process_ready_nodes();
+
+    if (variables.size() > 1) {
+        throw string("Systems of equations can't be evaluated from a stream");
+    }
+
+    scalar result;
+
+    try {
+        result = pop_result(buffer);
+    } catch (string error) {
+        throw string("Error in processing reverse polish notation: " + error);
+    }
+
+    return contains_variable ? result.solve_degree_1() : result.get_0();
+}
+
+bool Calculator::is_linear_system(const vector<Token> & tokens) {
+    vector<int> names;
+    for (const auto & token : tokens) {
+        if (token.token_type == TOKEN_VARIABLE && !is_bound(token.symbol) &&
+            find(names.begin(), names.end(), token.symbol) == names.end()) {
+            names.push_back(token.symbol);
+        }
+    }
+
+    return names.size() > 1;
+}
+
+vector<vector<Token>> Calculator::tokenize_system(const string & expression) {
+    vector<vector<Token>> equations;
+
+    stringstream equations_stream(expression);
+    string equation;
+    while (getline(equations_stream, equation, SEMICOLON)) {
+        if (equation.find_first_not_of(" \t") == string::npos) {
+            equations.emplace_back();
+            continue;
+        }
+
+        try {
+            equations.push_back(tokenize_expression(equation));
+        } catch (string error) {
+            throw string("Error in tokenizer: " + error + "\n");
+        }
+    }
+
+    return equations;
+}
+
+string Calculator::solve_linear_system(const vector<vector<Token>> & system_tokens) {
+    variables.clear();
+
+    // Each equation is reduced to a polynomial which is linear in all the variables
+    vector<scalar> equations;
+
+    for (unsigned int i = 0; i < system_tokens.size(); ++i) {
+        const auto & tokens = system_tokens[i];
+        int nr_equation = i + 1;
+        if (tokens.empty()) {
+            continue;
+        }
+
+        int nr_equal_signs = 0;
+        for (const auto & token : tokens) {
+            nr_equal_signs += token.token_type == TOKEN_EQUAL_SIGN;
+        }
+
+        if (nr_equal_signs != 1) {
+            throw string("Equation " + to_string(nr_equation) + " must contain exactly one equal sign");
+        }
+
+        vector<unique_ptr<AbstractNode>> output_queue;
+        try {
+            output_queue = build_reverse_polish_notation(tokens);
+        } catch (string error) {
+            throw string("Error in building reverse polish notation: " + error);
+        }
+
+        try {
+            equations.push_back(process_reverse_polish_notation(output_queue));
+        } catch (string error) {
+            throw string("Error in processing reverse polish notation: " + error);
+        }
+    }
+
+    if (variables.empty()) {
+        throw string("System contains no variables");
+    }
+
+    // Extract the coefficient rows directly into the matrix of the system
+    LinearSystem system(equations.size(), variables.size());
+    for (unsigned int i = 0; i < equations.size(); ++i) {
+        const auto & coeff = equations[i].get_coeff();
+        copy(coeff.begin() + 1, coeff.end(), system.equation(i));
+        system.constant(i) = -coeff[0];
+    }
+
+    auto solution = system.solve();
+
+    stringstream ss;
+    for (unsigned int i = 0; i < variables.size(); ++i) {
+        // adding 0 turns -0 into 0
+        ss << (i ? ", " : "") << symbols.name(variables[i]) << " = " << solution[i] + 0.0;
+    }
+    return ss.str();
+}
+
 string Calculator::eval(const string & expression) {
     try {
-        auto result = compute_constant_result (expression); 
+        if (expression.find(SEMICOLON) != string::npos) {
+            return solve_linear_system(tokenize_system(expression));
+        }
+
+        // The expression is tokenized once, whether it is a system or not
+        vector<Token> tokens;
+        try {
+            tokens = tokenize_expression(expression);
+        } catch (string error) {
+            throw string("Error in tokenizer: " + error + "\n");
+        }
+
+        if (is_linear_system(tokens)) {
+            return solve_linear_system({tokens});
+        }
+
+        auto result = compute_constant_result (tokens); 
     
         stringstream ss;
         ss << result;
@@ -404,11 +743,110 @@ string Calculator::eval(const string & expression) {
     }
 }
 
+string Calculator::eval_stream(istream & input) {
+    try {
+        auto result = compute_streaming_result(input);
+
+        stringstream ss;
+        ss << result;
+        return ss.str();
+    } catch (string error) {
+        return error;
+    }
+}
+
+shared_ptr<CompiledExpression> Calculator::compile(const string & expression) {
+    return compile(expression, accuracy);
+}
+
+shared_ptr<CompiledExpression> Calculator::compile(const string & expression, MathAccuracy expression_accuracy) {
+    variables.clear();
+
+    vector<Token> tokens;
+    try {
+        tokens = tokenize_expression(expression);
+    } catch (string error) {
+        throw string("Error in tokenizer: " + error + "\n");
+    }
+
+    for (const auto & token : tokens) {
+        if (token.token_type == TOKEN_EQUAL_SIGN) {
+            throw string("Compiled expressions can't contain an equal sign");
+        }
+    }
+
+    // The nodes are built with the tier of the calculator, which is restored once the program is built
+    MathAccuracy calculator_accuracy = accuracy;
+    accuracy = expression_accuracy;
+    try {
+        // The variables are known once the program is built
+        Program program = build_reverse_polish_notation(tokens);
+        accuracy = calculator_accuracy;
+        return make_shared<CompiledExpression>(move(program), get_variable_names(), symbols);
+    } catch (string error) {
+        accuracy = calculator_accuracy;
+        throw string("Error in building reverse polish notation: " + error);
+    }
+}
+
+Program Calculator::build_search_program(const string & expression) {
+    variables.clear();
+
+    vector<Token> tokens;
+    try {
+        tokens = tokenize_expression(expression);
+    } catch (string error) {
+        throw string("Error in tokenizer: " + error + "\n");
+    }
+
+    int nr_equal_signs = 0;
+    for (const auto & token : tokens) {
+        nr_equal_signs += token.token_type == TOKEN_EQUAL_SIGN;
+    }
+
+    if (nr_equal_signs > 1) {
+        throw string("Expression can't contain more than one equal sign");
+    }
+
+    Program program;
+    try {
+        program = build_reverse_polish_notation(tokens);
+        CompiledExpression::prepare(program, symbols);
+    } catch (string error) {
+        throw string("Error in building reverse polish notation: " + error);
+    }
+
+    if (variables.size() > 1) {
+        throw string("Expression can't contain more than one variable");
+    }
+
+    return program;
+}
+
+RootEnclosures Calculator::find_roots(const string & expression, value_type a, value_type b, value_type tolerance) {
+    Program program = build_search_program(expression);
+    return IntervalSearch(program).find_roots(a, b, tolerance);
+}
+
+ExtremumEnclosure Calculator::find_maximum(const string & expression, value_type a, value_type b, value_type tolerance) {
+    Program program = build_search_program(expression);
+    return IntervalSearch(program).find_maximum(a, b, tolerance);
+}
+
+ExtremumEnclosure Calculator::find_minimum(const string & expression, value_type a, value_type b, value_type tolerance) {
+    Program program = build_search_program(expression);
+    return IntervalSearch(program).find_minimum(a, b, tolerance);
+}
+
 void Calculator::test() {
     assert (eval("4 + 9") == "13");
 
     assert (eval("x + 5 = 11") == "6");
     assert (eval("x * 0 = 10") == "Constant can't equal 0, no solutions");
+    // The variable only appears in the branch which is not taken
+    assert (eval("if(0, x, 2) = 3") == "Constant can't equal 0, no solutions");
+    assert (eval("if(1, 2, x) = 3") == "Constant can't equal 0, no solutions");
+    assert (eval("if(1, 3, x) = 3") == "Expression evaluates to 0, infinite number of solutions");
     
     assert (eval("=") == "Expression must contain both a variable and equal sign or neither");
 
@@ -419,4 +857,474 @@ void Calculator::test() {
     assert (eval("(5") == "Error in building reverse polish notation: Mismatched parantheses");
 
     assert (eval("lag(10)") == "Error in building reverse polish notation: Invalid mathematical function lag");
+
+    // Errors are reported instead of exiting the program
+    assert (eval("1 $ 2") == "Error in tokenizer: Invalid operator\n");
+    assert (eval("1 / 0") == "Error in processing reverse polish notation: Can't divide polynomial by 0");
+    assert (eval("1" + string(400, '0') + " + 1") == "Error in tokenizer: Invalid floating number: out of the range of double\n");
+    assert (eval("0." + string(400, '0') + "1") == "Error in tokenizer: Invalid floating number: out of the range of double\n");
+
+    assert (eval("5 = x") == "5");
+    assert (eval("2y - 4 = 0") == "2");
+    assert (eval("x + 1 = 2 + 3") == "4");
+    assert (eval("x = 2 - 3") == "-1");
+
+    // A negation doesn't complete the negations before it
+    assert (eval("--5") == "5");
+    assert (eval("2 * - -3") == "6");
+    assert (eval("(10 - --8) - -1") == "3");
+
+    assert (eval("2a + 3b = 7; a - b = 1") == "a = 2, b = 1");
+    assert (eval("u + v + w = 6; u - v = 0; 2w = 6") == "u = 1.5, v = 1.5, w = 3");
+    assert (eval("a + b = 2; 2a + 2b = 4") == "System has 1 independent equations for 2 unknowns, infinite number of solutions");
+    assert (eval("a + b = 2; a + b = 3") == "System is inconsistent, no solutions");
+    assert (eval("a + b = 2") == "System has 1 independent equations for 2 unknowns, infinite number of solutions");
+    assert (eval("a = 1; b = 2; a + b = 3") == "a = 1, b = 2");
+    assert (eval("a + b; a = 1") == "Equation 1 must contain exactly one equal sign");
+
+    // Large system solved by the blocked LU decomposition
+    int n = 300;
+    LinearSystem system(n, n);
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j)
+            system.equation(i)[j] = (i == j) ? n : 1.0 / (1 + i + 2 * j);
+        system.constant(i) = i;
+    }
+    auto solution = system.solve();
+    for (int i = 0; i < n; ++i) {
+        value_type sum = 0;
+        for (int j = 0; j < n; ++j)
+            sum += system.equation(i)[j] * solution[j];
+        assert (abs(sum - system.constant(i)) < 1e-9);
+    }
+
+    // Maximum error of the accuracy tiers over dense sweeps
+    struct {
+        value_type (*kernel)(value_type, MathAccuracy);
+        value_type (*exact)(value_type);
+        value_type low, high;
+    } sweeps[] = {{math_sin, sin, -100, 100}, {math_cos, cos, -100, 100}, {math_sin, sin, -1e6, 1e6},
+                  {math_log, log, 1e-300, 1e-290}, {math_log, log, 1e-3, 1e3}, {math_log, log, 0.999, 1.001},
+                  {math_exp, exp, -700, 700}};
+    int nr_points = 1 << 16;
+    for (const auto & sweep : sweeps) {
+        uint64_t max_ulp_error = 0;
+        value_type max_relative_error = 0;
+        for (int i = 0; i < nr_points; ++i) {
+            value_type x = sweep.low + (sweep.high - sweep.low) * (i + 0.5) / nr_points;
+            value_type expected = sweep.exact(x);
+            max_ulp_error = max(max_ulp_error, ulp_distance(sweep.kernel(x, ACCURACY_1ULP), expected));
+            max_relative_error = max(max_relative_error, abs(sweep.kernel(x, ACCURACY_FAST) - expected) / abs(expected));
+        }
+        assert (max_ulp_error <= 1);
+        assert (max_relative_error < 1e-7);
+    }
+
+    // Points next to the zeros of sin and cos, where the range reduction cancels most of the argument
+    struct {
+        value_type (*kernel)(value_type, MathAccuracy);
+        value_type (*exact)(value_type);
+        // The zeros are at (k + zero_offset) * pi, every step-th of them is sampled
+        value_type zero_offset;
+        int step;
+    } zero_sweeps[] = {{math_sin, sin, 0, 1}, {math_cos, cos, 0.5, 1}, {math_sin, sin, 0, 7}, {math_cos, cos, 0.5, 7}};
+    for (const auto & sweep : zero_sweeps) {
+        uint64_t max_ulp_error = 0;
+        value_type max_relative_error = 0;
+        for (int i = 0; i < nr_points; ++i) {
+            value_type zero = ((i - nr_points / 2) * sweep.step + sweep.zero_offset) * M_PI;
+            for (value_type x : {nextafter(zero, -INFINITY), zero, nextafter(zero, INFINITY)}) {
+                value_type expected = sweep.exact(x);
+                max_ulp_error = max(max_ulp_error, ulp_distance(sweep.kernel(x, ACCURACY_1ULP), expected));
+                max_relative_error = max(max_relative_error, abs(sweep.kernel(x, ACCURACY_FAST) - expected) / abs(expected));
+            }
+        }
+        assert (max_ulp_error <= 1);
+        assert (max_relative_error < 1e-7);
+    }
+
+    value_type max_relative_error = 0;
+    for (int i = 0; i < nr_points; ++i) {
+        value_type x = 1e-3 + 100.0 * i / nr_points, y = -20 + 40.0 * i / nr_points;
+        max_relative_error = max(max_relative_error, abs(math_pow(x, y, ACCURACY_FAST) - pow(x, y)) / pow(x, y));
+    }
+    assert (max_relative_error < 1e-7);
+
+    // The accuracy tier is chosen when the expression is compiled
+    for (auto tier : {ACCURACY_1ULP, ACCURACY_FAST}) {
+        set_accuracy(tier);
+        assert (eval("sin(pow(( 4 - 9 / 100),  2)) - max(cos(12), 4 * 2)") == "-7.59236");
+        assert (eval("x + x * (10 / cos(2)) = min(15, pow(2, 3))") == "-0.347373");
+        assert (eval("log(10) * 2") == "4.60517");
+    }
+    set_accuracy(ACCURACY_EXACT);
+
+    // A tier given to compile only applies to that expression
+    auto sin_fast_tier = compile("sin(x)", ACCURACY_FAST);
+    assert (abs(sin_fast_tier->evaluate({0.5}) - sin(0.5)) < 1e-7);
+    assert (eval("sin(0.5)") == "0.479426");
+    assert (compile("sin(x)")->evaluate({0.5}) == sin(0.5));
+
+    // Aggregate functions over bound columns
+    vector<value_type> column(100000);
+    for (unsigned int i = 0; i < column.size(); ++i)
+        column[i] = i + 1;
+    bind("x", column);
+    bind("n", value_type(column.size()));
+
+    assert (eval("sum(pow(x, 2)) / n") == "3.33338e+09");
+    assert (eval("dot(x, x) / n") == "3.33338e+09");
+    assert (eval("mean(x)") == "50000.5");
+    assert (eval("sum(x - mean(x))") == "0");
+    assert (eval("sum(1) - n") == "Error in processing reverse polish notation: sum must be applied over a bound column");
+    assert (eval("x + 1") == "Error in processing reverse polish notation: Column x can only be used inside an aggregate function");
+    assert (eval("sum(1 / (x - 7))") == "Error in processing reverse polish notation: Can't divide polynomial by 0");
+    assert (eval("n * t = 10") == "0.0001");
+
+    bind("y", vector<value_type>(3, 1.0));
+    assert (eval("dot(x, y)") == "Error in processing reverse polish notation: Columns of different lengths used in dot");
+
+    // The sums of the chunks are combined with compensated summation, so the small ones are not lost
+    vector<value_type> chunk_values(4 * REDUCTION_CHUNK_SIZE);
+    chunk_values[0] = 1e16;
+    chunk_values[REDUCTION_CHUNK_SIZE] = 1;
+    chunk_values[2 * REDUCTION_CHUNK_SIZE] = -1e16;
+    chunk_values[3 * REDUCTION_CHUNK_SIZE] = 1;
+    bind("y", chunk_values);
+    assert (eval("sum(y)") == "2");
+
+    clear_bindings();
+
+    // Compiled expressions start in the interpreter and are promoted to bytecode once hot
+    auto compiled = compile("x * 2 + sin(y) * (3 - 1) / pow(2, 2)");
+    assert ((compiled->get_arguments() == vector<string>{"x", "y"}));
+    value_type interpreted = compiled->evaluate({1.5, 0.25});
+    assert (compiled->profile().tier == TIER_INTERPRETER);
+
+    for (int i = 1; i < PROMOTION_THRESHOLD; ++i)
+        compiled->evaluate({1.5, 0.25});
+    compiled->wait_for_promotion();
+
+    auto profile = compiled->profile();
+    assert (profile.tier == TIER_BYTECODE);
+    assert (profile.calls == PROMOTION_THRESHOLD);
+    assert (profile.total_seconds > 0);
+    // x 2 * y sin 2 * 4 / +, the constants 3 - 1 and pow(2, 2) are folded
+    assert (profile.instructions == 10);
+    assert (compiled->evaluate({1.5, 0.25}) == interpreted);
+
+    vector<value_type> xs(3000), ys(3000), batch(3000);
+    for (int i = 0; i < 3000; ++i)
+        xs[i] = i * 0.5, ys[i] = i * 0.001;
+    compiled->evaluate_batch({xs.data(), ys.data()}, batch.data(), 3000);
+    for (int i = 0; i < 3000; ++i)
+        assert (batch[i] == compiled->evaluate({xs[i], ys[i]}));
+
+    try {
+        compile("1 / x")->evaluate({0});
+        assert (false);
+    } catch (string error) {
+        assert (error == "Can't divide polynomial by 0");
+    }
+
+    // Comparisons and conditionals, the branch which is not taken is not evaluated
+    assert (eval("1 < 2") == "1");
+    assert (eval("2 <= 1") == "0");
+    assert (eval("1 + 2 == 3") == "1");
+    assert (eval("1 != 1") == "0");
+    assert (eval("-1 >= -2") == "1");
+    assert (eval("if(1 < 2, 10, 1 / 0)") == "10");
+    assert (eval("if(2 < 1, log(0), 7)") == "7");
+    assert (eval("if(0, 1, if(1 < 0, 2, 3)) * 2") == "6");
+    assert (eval("if(1, x, 2) = 3") == "3");
+    assert (eval("if(x, 1, 2) = 3") == "Error in processing reverse polish notation: The condition of if can't depend on the variable");
+    assert (eval("if(1, 2)") == "Error in building reverse polish notation: Insufficient number of operands for if");
+
+    set_parallel_evaluation(true, 1);
+    assert (eval("if(1 < 2, 3, 1 / 0) + if(0, 1, 2) * 5") == "13");
+    set_parallel_evaluation(false);
+
+    // Over columns the rows are split by branch, so log is only applied on the positive values
+    vector<value_type> zs(3000);
+    value_type expected_sum = 0;
+    for (int i = 0; i < 3000; ++i) {
+        zs[i] = i % 7 - 3;
+        expected_sum += zs[i] > 0 ? log(zs[i]) : -zs[i];
+    }
+    bind("z", zs);
+    assert (abs(stod(eval("sum(if(z > 0, log(z), -z))")) - expected_sum) < 1e-4 * expected_sum);
+    assert (eval("sum(if(z > -10, z, log(z)))") == "-6");
+    assert (eval("sum(if(z > 0, if(z > 2, 1, 2), 0))") == "2140");
+    clear_bindings();
+
+    auto piecewise = compile("if(x < 0, -x, if(x < 1, x * x, log(x)))");
+    for (int i = 0; i < PROMOTION_THRESHOLD; ++i)
+        piecewise->evaluate({i * 0.01 - 2});
+    piecewise->wait_for_promotion();
+    assert (piecewise->is_promoted());
+    assert (piecewise->evaluate({-2}) == 2 && piecewise->evaluate({0.5}) == 0.25 && piecewise->evaluate({exp(2.0)}) == 2);
+
+    vector<value_type> piecewise_values(3000);
+    for (int i = 0; i < 3000; ++i)
+        xs[i] = i % 2 ? i * 0.01 - 2 : 1 - i * 0.001;
+    piecewise->evaluate_batch({xs.data()}, piecewise_values.data(), 3000);
+    for (int i = 0; i < 3000; ++i)
+        assert (piecewise_values[i] == piecewise->evaluate({xs[i]}));
+
+    // A constant condition is folded, only the chosen branch is compiled
+    auto folded = compile("if(2 > 1, x, log(x))");
+    for (int i = 0; i < PROMOTION_THRESHOLD; ++i)
+        folded->evaluate({1});
+    folded->wait_for_promotion();
+    assert (folded->profile().instructions == 1);
+    assert (folded->evaluate({-1}) == -1);
+
+    // Interval arithmetic rounds outward: 0.1 + 0.2 is 0.30000000000000004 in floating point
+    assert ((Interval(0.1) + Interval(0.2)).contains(0.3));
+    assert (interval_sin(Interval(0, 2)).hi == 1 && interval_cos(Interval(3, 4)).lo == -1);
+    assert (interval_pow(Interval(-2, 3), Interval(2)).lo == 0 && interval_pow(Interval(-2, -1), Interval(0.5)).is_empty());
+    // A negative base takes the values of the integer exponents of the interval, of both signs when it holds two
+    assert (interval_pow(Interval(-2), Interval(1.5, 2.5)).contains(4) && !interval_pow(Interval(-2), Interval(1.5, 2.5)).contains(-8));
+    assert (interval_pow(Interval(-2), Interval(1.5, 3.5)).contains(4) && interval_pow(Interval(-2), Interval(1.5, 3.5)).contains(-8));
+    assert (interval_pow(Interval(-2, -1), Interval(2.2, 2.8)).is_empty());
+    assert (interval_compare(Interval(0, 1), Interval(2, 3), less<value_type>()).lo == 1);
+
+    // Every root is enclosed, the boxes without a root are discarded without sampling them
+    auto enclosed = [](const vector<Interval> & enclosures, value_type value) {
+        for (const auto & enclosure : enclosures)
+            if (enclosure.contains(value) && enclosure.width() <= 2 * INTERVAL_TOLERANCE)
+                return true;
+        return false;
+    };
+
+    auto roots = find_roots("x * x = 2", -10, 10);
+    assert (roots.converged && roots.roots.size() == 2 && enclosed(roots.roots, -sqrt(2.0)) && enclosed(roots.roots, sqrt(2.0)));
+    assert (roots.evaluations < 1000);
+
+    roots = find_roots("sin(x) = 0.5", -10, 10);
+    assert (roots.roots.size() == 7);
+    for (int k = -2; k <= 1; ++k) {
+        assert (k == -2 || enclosed(roots.roots, asin(0.5) + 2 * M_PI * k));
+        assert (enclosed(roots.roots, M_PI - asin(0.5) + 2 * M_PI * k));
+    }
+
+    roots = find_roots("if(x < 0, -x - 1, x * x - 4)", -10, 10);
+    assert (roots.roots.size() == 2 && enclosed(roots.roots, -1) && enclosed(roots.roots, 2));
+    roots = find_roots("log(x) + pow(x, 3) = 1", -10, 10);
+    assert (roots.roots.size() == 1 && enclosed(roots.roots, 1));
+    assert (find_roots("pow(x, 3) = -8", -10, 10).roots.size() == 1);
+    roots = find_roots("pow(-2, x) = 4", 0, 5);
+    assert (roots.roots.size() == 1 && enclosed(roots.roots, 2));
+    assert (find_roots("1 / x", -10, 10).roots.empty());
+
+    // The whole range is a root, the search stops refining at INTERVAL_MAX_BOXES boxes
+    roots = find_roots("x - x = 0", -1, 1);
+    assert (!roots.converged && roots.roots.size() == 1 && roots.roots[0].lo == -1 && roots.roots[0].hi == 1);
+
+    auto maximum = find_maximum("x * (1 - x)", -3, 4);
+    assert (maximum.converged && maximum.value.contains(0.25) && maximum.value.width() <= 2 * INTERVAL_EXTREMUM_TOLERANCE);
+    assert (maximum.locations.front().lo <= 0.5 && 0.5 <= maximum.locations.back().hi);
+
+    // The maximum of sin(x) + x / 10 is where cos(x) = -0.1
+    maximum = find_maximum("sin(x) + x / 10", -3, 4);
+    assert (maximum.value.contains(sin(acos(-0.1)) + acos(-0.1) / 10));
+
+    auto minimum = find_minimum("x * (1 - x)", -3, 4);
+    assert (minimum.value.contains(-12) && minimum.locations.size() == 2);
+    assert (find_minimum("if(x > 1, log(x), 0 - x * x)", -3, 4).value.contains(-9));
+
+    // Comparisons outside of the domain have no value, so the branch they would select can't be the extremum
+    assert (interval_compare(Interval::empty(), Interval(0), greater<value_type>()).is_empty());
+    maximum = find_maximum("if(log(x) > 100, 100, 0)", -1, 1);
+    assert (maximum.value.lo == 0 && maximum.value.hi == 0);
+    minimum = find_minimum("if(log(x) < -100, -100, 0)", -1, 1);
+    assert (minimum.value.lo == 0 && minimum.value.hi == 0);
+
+    try {
+        find_roots("x + y = 1", 0, 1);
+        assert (false);
+    } catch (string error) {
+        assert (error == "Expression can't contain more than one variable");
+    }
+
+    // Parallel evaluation of a large expression: a long chain of additions whose terms are balanced trees
+    vector<Token> tokens;
+    function<void(int, int)> add_tree = [&](int low, int high) {
+        if (high - low == 1) {
+            tokens.push_back(Token (TOKEN_FUNCTION, SYMBOL_SIN));
+            tokens.push_back(Token (TOKEN_LEFT_PARANTHESES));
+            tokens.push_back(Token (TOKEN_NUMBER, NO_SYMBOL, low));
+            tokens.push_back(Token (TOKEN_RIGHT_PARANTHESES));
+            return;
+        }
+        tokens.push_back(Token (TOKEN_LEFT_PARANTHESES));
+        add_tree(low, (low + high) / 2);
+        tokens.push_back(Token (TOKEN_OPERATOR, (low + high) % 2 ? SYMBOL_ADD : SYMBOL_SUBSTRACT));
+        add_tree((low + high) / 2, high);
+        tokens.push_back(Token (TOKEN_RIGHT_PARANTHESES));
+    };
+    for (int term = 0; term < 200; ++term) {
+        if (term > 0) {
+            tokens.push_back(Token (TOKEN_OPERATOR, SYMBOL_ADD));
+        }
+        add_tree(term, term + (term % 3 ? 20 : 500));
+    }
+
+    auto output_queue = build_reverse_polish_notation(tokens);
+    auto sequential = process_reverse_polish_notation(output_queue);
+    set_parallel_evaluation(true, 64);
+    auto parallel = process_reverse_polish_notation(output_queue);
+    set_parallel_evaluation(false);
+    assert (parallel.get_0() == sequential.get_0());
+
+    // Streaming evaluation
+    auto eval_string_stream = [this](const string & expression) {
+        istringstream input(expression);
+        return eval_stream(input);
+    };
+
+    assert (eval_string_stream("4 + 9") == "13");
+    assert (eval_string_stream("x + 5 = 11") == "6");
+    assert (eval_string_stream("2y - 4 = 0") == "2");
+    assert (eval_string_stream("if(0, x, 2) = 3") == "Constant can't equal 0, no solutions");
+    assert (eval_string_stream("if(1, 2, x) = 3") == "Constant can't equal 0, no solutions");
+    assert (eval_string_stream("if(1, 3, x) = 3") == "Expression evaluates to 0, infinite number of solutions");
+    assert (eval_string_stream("=") == "Expression must contain both a variable and equal sign or neither");
+    assert (eval_string_stream("(5") == "Error in building reverse polish notation: Mismatched parantheses");
+    assert (eval_string_stream("max(1)") == "Error in processing reverse polish notation: Insufficient number of operands for max");
+    assert (eval_string_stream("1 $ 2") == "Error in tokenizer: Invalid operator\n");
+    assert (eval_string_stream("a + b = 1") == "Systems of equations can't be evaluated from a stream");
+    assert (eval_string_stream("if(1 < 2, 10, 1 / 0) + if(0, log(0), 1)") == "11");
+
+    // Tokens crossing the chunks of the lexer
+    string padding(LEXER_CHUNK_SIZE - 3, ' ');
+    assert (eval_string_stream(padding + "123456 + sin (0)") == eval("123456 + sin(0)"));
+    assert (eval_string_stream(padding + "-x / 2 = 3") == "-6");
+
+    string long_expression = "1";
+    string nested_expression = "1";
+    for (int i = 0; i < 100000; ++i) {
+        long_expression += i % 2 ? " + 2" : " - 1";
+        if (i < 10000) {
+            nested_expression = "(" + nested_expression + "+1)";
+        }
+    }
+    assert (eval_string_stream(long_expression) == eval(long_expression));
+    assert (eval_string_stream(nested_expression) == "10001");
+
+    vector<value_type> values(5000);
+    for (unsigned int i = 0; i < values.size(); ++i)
+        values[i] = i + 1;
+    bind("v", values);
+    string aggregate_expression = "sum(v) / 2 + mean(v * 2) - sum(v - mean(v)) + dot(v, v) / sum(v)";
+    assert (eval_string_stream(aggregate_expression) == eval(aggregate_expression));
+    assert (eval_string_stream("sum(v) = 2 * n") == "6.25125e+06");
+    assert (eval_string_stream("v + 1") == "Error in processing reverse polish notation: Column v can only be used inside an aggregate function");
+
+    // Clearing the symbols keeps the bound variables and the compiled expressions
+    auto compiled_before = compile("first * 2");
+    bind("w", value_type(3));
+    clear_symbols();
+    assert (nr_symbols() == NR_BUILTIN_SYMBOLS + 2);
+    assert (eval("sum(v) / 5000 + w") == "2503.5");
+    assert (compiled_before->evaluate({4}) == 8);
+    clear_bindings();
+}
+
+void Calculator::benchmark() {
+    const char * tier_names[] = {"exact", "1ulp", "fast"};
+    int n = 1 << 20;
+
+    vector<value_type> angles(n), positives(n), exponents(n), result(n);
+    for (int i = 0; i < n; ++i) {
+        angles[i] = -100 + 200.0 * i / n;
+        positives[i] = 1e-3 + 1e3 * i / n;
+        exponents[i] = -5 + 10.0 * i / n;
+    }
+
+    auto throughput = [n](const function<void()> & kernel) {
+        auto start = chrono::steady_clock::now();
+        kernel();
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        return n / elapsed.count() / 1e6;
+    };
+
+    cout << "Throughput in millions of values per second, formula in thousands of evaluations per second\n";
+    cout << setw(8) << "tier" << setw(10) << "sin" << setw(10) << "cos" << setw(10) << "log"
+         << setw(10) << "pow" << setw(10) << "formula" << "\n";
+
+    for (int tier = ACCURACY_EXACT; tier <= ACCURACY_FAST; ++tier) {
+        MathAccuracy accuracy = MathAccuracy(tier);
+        cout << setw(8) << tier_names[tier] << fixed << setprecision(1);
+        cout << setw(10) << throughput([&] { math_sin(angles.data(), result.data(), n, accuracy); });
+        cout << setw(10) << throughput([&] { math_cos(angles.data(), result.data(), n, accuracy); });
+        cout << setw(10) << throughput([&] { math_log(positives.data(), result.data(), n, accuracy); });
+        cout << setw(10) << throughput([&] { math_pow(positives.data(), exponents.data(), result.data(), n, accuracy); });
+
+        // A trig heavy formula evaluated through the scalar evaluator
+        set_accuracy(accuracy);
+        int nr_evaluations = 10000;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < nr_evaluations; ++i)
+            eval("sin(1.5) * cos(2.5) + sin(pow(cos(0.5), 2)) - log(sin(1) + 2)");
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << setw(10) << nr_evaluations / elapsed.count() / 1e3 << "\n";
+        cout.unsetf(ios::fixed);
+    }
+    set_accuracy(ACCURACY_EXACT);
+
+    // The stages of the evaluation of a large expression
+    string expression = "1";
+    for (int i = 0; i < 100000; ++i)
+        expression += " + max(2.5, 3) * 4 - sin(0.5) / 2";
+
+    auto nanoseconds_per_token = [](chrono::steady_clock::time_point start, int nr_tokens) {
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        return elapsed.count() * 1e9 / nr_tokens;
+    };
+
+    auto start = chrono::steady_clock::now();
+    auto tokens = tokenize_expression(expression);
+    double tokenizer_time = nanoseconds_per_token(start, tokens.size());
+
+    start = chrono::steady_clock::now();
+    auto output_queue = build_reverse_polish_notation(tokens);
+    double shunting_yard_time = nanoseconds_per_token(start, tokens.size());
+
+    start = chrono::steady_clock::now();
+    process_reverse_polish_notation(output_queue);
+    double evaluation_time = nanoseconds_per_token(start, tokens.size());
+
+    cout << "\nEvaluation of an expression of " << tokens.size() << " tokens in nanoseconds per token\n";
+    cout << fixed << setprecision(1) << setw(12) << "tokenizer" << setw(14) << "shunting-yard" << setw(12) << "evaluation" << "\n";
+    cout << setw(12) << tokenizer_time << setw(14) << shunting_yard_time << setw(12) << evaluation_time << "\n";
+    cout.unsetf(ios::fixed);
+
+    cout << "Size in bytes of a token: " << sizeof(Token) << ", a number: " << sizeof(Scalar) << ", an operator: " << sizeof(FunctionAdd)
+         << ", a column: " << sizeof(Column) << "\n";
+
+    // Branch-and-bound searches on [-10, 10], dense sampling would need a sample per tolerance
+    cout << "\nInterval search on [-10, 10], evaluations compared to the samples of the same resolution\n";
+    cout << setw(32) << "search" << setw(12) << "enclosures" << setw(13) << "evaluations" << setw(12) << "samples"
+         << setw(10) << "ms" << "\n";
+
+    auto report = [](const string & name, int nr_enclosures, long long evaluations, value_type tolerance,
+                     chrono::steady_clock::time_point start) {
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << setw(32) << name << setw(12) << nr_enclosures << setw(13) << evaluations << setw(12) << setprecision(2)
+             << 20 / tolerance << setw(10) << fixed << elapsed.count() * 1e3 << "\n";
+        cout.unsetf(ios::fixed);
+    };
+
+    for (string equation : {"x * x = 2", "cos(3x) + x / 10 = 0", "sin(pow(x, 2)) = 0.5"}) {
+        start = chrono::steady_clock::now();
+        auto roots = find_roots(equation, -10, 10);
+        report("roots of " + equation, roots.roots.size(), roots.evaluations, INTERVAL_TOLERANCE, start);
+    }
+
+    for (string formula : {"sin(x) + x / 10", "x * (1 - x)"}) {
+        start = chrono::steady_clock::now();
+        auto maximum = find_maximum(formula, -10, 10);
+        report("maximum of " + formula, maximum.locations.size(), maximum.evaluations, INTERVAL_EXTREMUM_TOLERANCE, start);
+    }
 }
\ No newline at end of file
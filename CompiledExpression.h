@@ -0,0 +1,259 @@
+/*
+An expression compiled once and evaluated many times with different values of its variables
+
+Execution is tiered. A new expression runs in the RPN interpreter. Once it has been called
+promotion_threshold times it is compiled to constant-folded bytecode by a task of the shared
+TaskScheduler, while the callers keep using the interpreter until the bytecode is published. Only single
+calls run the bytecode: once the expression is promoted, batches of rows switch from the interpreter to the
+BatchEvaluator over the program, which evaluates whole columns with the vectorized kernels and is 2 to 10
+times faster than running the bytecode row by row. There is no native code tier.
+
+Every expression counts its calls and samples their duration, see profile().
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "Bytecode.h"
+#include "Reduction.h"
+#include "TaskScheduler.h"
+
+#define PROMOTION_THRESHOLD 1000
+// One call out of PROFILE_SAMPLE_PERIOD is timed
+#define PROFILE_SAMPLE_PERIOD 16
+
+enum ExecutionTier {TIER_INTERPRETER, TIER_BYTECODE};
+
+struct ExpressionProfile {
+    uint64_t calls;
+    // Estimated from the timed calls
+    double total_seconds;
+    ExecutionTier tier;
+    // Size of the bytecode, 0 before promotion
+    int instructions;
+};
+
+class CompiledExpression {
+private:
+    Program program;
+    // Names of the variables, in the order of the values given to evaluate
+    vector<string> arguments;
+    uint64_t promotion_threshold;
+
+    atomic<uint64_t> calls;
+    atomic<uint64_t> timed_calls;
+    atomic<uint64_t> timed_nanoseconds;
+
+    Bytecode bytecode;
+    atomic<bool> promoted;
+    atomic<bool> promotion_started;
+    // Set once the promotion succeeded or failed
+    atomic<bool> promotion_finished;
+
+    value_type interpret(const Program & program, const value_type * values) const;
+
+    // Counts the calls and starts the promotion once the expression is hot
+    void count_calls(uint64_t nr_calls);
+
+    void record_time(uint64_t nr_calls, chrono::steady_clock::time_point start);
+
+    void promote();
+public:
+    // Reduces the aggregates and checks the program and the arguments of its conditionals
+    static void prepare(Program & program, const SymbolTable & symbols);
+
+    // Aggregate functions are reduced once, using the columns bound when the expression is compiled
+    // The symbols of the program are only used to report errors
+    CompiledExpression (Program _program, vector<string> _arguments, const SymbolTable & symbols,
+                        uint64_t _promotion_threshold = PROMOTION_THRESHOLD);
+
+    ~CompiledExpression ();
+
+    const vector<string> & get_arguments() const {
+        return arguments;
+    }
+
+    value_type evaluate(const vector<value_type> & values);
+
+    // Evaluates the expression on n rows, columns[k] being the values of the k-th variable
+    void evaluate_batch(const vector<const value_type *> & columns, value_type * result, int n);
+
+    // Compiles the bytecode on the calling thread without waiting for the expression to be hot,
+    // does nothing if the promotion already started
+    void optimize();
+
+    // Waits until the promotion is finished if it started, running the pending tasks of the scheduler meanwhile
+    void wait_for_promotion();
+
+    bool is_promoted() const {
+        return promoted.load(memory_order_acquire);
+    }
+
+    ExpressionProfile profile() const;
+};
+
+//////////////////////////////////////////////////////////////
+
+CompiledExpression::CompiledExpression(Program _program, vector<string> _arguments, const SymbolTable & symbols,
+                                       uint64_t _promotion_threshold) :
+        program(move(_program)), arguments(move(_arguments)), promotion_threshold(_promotion_threshold),
+        calls(0), timed_calls(0), timed_nanoseconds(0), promoted(false), promotion_started(false),
+        promotion_finished(false) {
+    prepare(program, symbols);
+}
+
+void CompiledExpression::prepare(Program & program, const SymbolTable & symbols) {
+    int stack_size = 0;
+    for (auto & node : program) {
+        if (node->get_type() == NODE_COLUMN) {
+            throw string("Column " + symbols.name(node->get_symbol()) + " can only be used inside an aggregate function");
+        } else if (node->get_type() == NODE_AGGREGATE) {
+            value_type value = dynamic_cast<AggregateFunction*>(node.get())->reduce();
+            node = unique_ptr<AbstractNode>(new Scalar(node->get_symbol(), value));
+        }
+
+        if (node->get_type() == NODE_CONDITIONAL) {
+            FunctionIf * conditional = dynamic_cast<FunctionIf*>(node.get());
+            for (int k = 0; k < conditional->get_arity(); ++k)
+                prepare(conditional->get_argument(k), symbols);
+        }
+
+        if (node->get_type() == NODE_SCALAR || node->get_type() == NODE_CONDITIONAL) {
+            ++stack_size;
+        } else {
+            Function * current_function = dynamic_cast<Function*>(node.get());
+            if (stack_size < current_function->get_arity()) {
+                throw string("Insufficient number of operands for " + current_function->get_identifier());
+            }
+            stack_size -= current_function->get_arity() - 1;
+        }
+    }
+
+    if (stack_size != 1) {
+        throw string(stack_size == 0 ? "Insufficient scalars left" : "Too many scalars left");
+    }
+}
+
+CompiledExpression::~CompiledExpression() {
+    // The promotion task uses the expression
+    wait_for_promotion();
+}
+
+value_type CompiledExpression::interpret(const Program & program, const value_type * values) const {
+    vector<value_type> stack;
+
+    for (const auto & node : program) {
+        if (node->get_type() == NODE_SCALAR) {
+            const Scalar * current_scalar = dynamic_cast<const Scalar*>(node.get());
+            if (current_scalar->is_variable()) {
+                stack.push_back(values[current_scalar->get_variable_index()]);
+            } else {
+                stack.push_back(current_scalar->get_constant());
+            }
+        } else if (node->get_type() == NODE_CONDITIONAL) {
+            const FunctionIf * conditional = dynamic_cast<const FunctionIf*>(node.get());
+            bool condition = interpret(conditional->get_argument(0), values) != 0;
+            stack.push_back(interpret(conditional->get_argument(condition ? 1 : 2), values));
+        } else {
+            const Function * current_function = dynamic_cast<const Function*>(node.get());
+            int first_operand = stack.size() - current_function->get_arity();
+            value_type result = current_function->apply_value(&stack[first_operand]);
+            stack.resize(first_operand);
+            stack.push_back(result);
+        }
+    }
+
+    return stack[0];
+}
+
+void CompiledExpression::count_calls(uint64_t nr_calls) {
+    if (calls.fetch_add(nr_calls) + nr_calls >= promotion_threshold && !promotion_started.exchange(true)) {
+        TaskScheduler::instance().submit([this] { promote(); });
+    }
+}
+
+void CompiledExpression::record_time(uint64_t nr_calls, chrono::steady_clock::time_point start) {
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+    timed_nanoseconds += elapsed.count();
+    timed_calls += nr_calls;
+}
+
+void CompiledExpression::promote() {
+    try {
+        bytecode = Bytecode::compile(program);
+        promoted.store(true, memory_order_release);
+    } catch (string error) {
+        // The expression stays in the interpreter
+    }
+    promotion_finished.store(true, memory_order_release);
+}
+
+void CompiledExpression::optimize() {
+    if (!promotion_started.exchange(true)) {
+        promote();
+    }
+}
+
+void CompiledExpression::wait_for_promotion() {
+    if (promotion_started.load()) {
+        TaskScheduler::instance().wait_until([this] { return promotion_finished.load(memory_order_acquire); });
+    }
+}
+
+value_type CompiledExpression::evaluate(const vector<value_type> & values) {
+    if (values.size() != arguments.size()) {
+        throw string("Expected " + to_string(arguments.size()) + " values for the variables");
+    }
+
+    bool timed = calls.load(memory_order_relaxed) % PROFILE_SAMPLE_PERIOD == 0;
+    auto start = timed ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+
+    value_type result = is_promoted() ? bytecode.run(values.data()) : interpret(program, values.data());
+
+    if (timed) {
+        record_time(1, start);
+    }
+    count_calls(1);
+
+    return result;
+}
+
+void CompiledExpression::evaluate_batch(const vector<const value_type *> & columns, value_type * result, int n) {
+    if (columns.size() != arguments.size()) {
+        throw string("Expected " + to_string(arguments.size()) + " columns for the variables");
+    }
+
+    auto start = chrono::steady_clock::now();
+
+    if (is_promoted()) {
+        BatchEvaluator evaluator;
+        for (int begin = 0; begin < n; begin += REDUCTION_CHUNK_SIZE) {
+            int length = min(REDUCTION_CHUNK_SIZE, n - begin);
+            const value_type * values = evaluator.evaluate(program, begin, length, columns.data());
+            copy(values, values + length, result + begin);
+        }
+    } else {
+        vector<value_type> row(arguments.size());
+        for (int i = 0; i < n; ++i) {
+            for (unsigned int k = 0; k < arguments.size(); ++k)
+                row[k] = columns[k][i];
+            result[i] = interpret(program, row.data());
+        }
+    }
+
+    record_time(n, start);
+    count_calls(n);
+}
+
+ExpressionProfile CompiledExpression::profile() const {
+    ExpressionProfile result;
+    result.calls = calls.load();
+    uint64_t nr_timed_calls = timed_calls.load();
+    result.total_seconds = nr_timed_calls ? 1e-9 * timed_nanoseconds.load() * result.calls / nr_timed_calls : 0;
+    result.tier = is_promoted() ? TIER_BYTECODE : TIER_INTERPRETER;
+    result.instructions = is_promoted() ? bytecode.size() : 0;
+    return result;
+}
@@ -0,0 +1,210 @@
+/*
+Grammar-aware generator of expressions for fuzzing and scaling measurements
+
+Random expressions follow the grammar of the calculator:
+    expression  term (operator term)*
+    term        number | -term | (expression) | function(expression, ...) | if(comparison, expression, expression)
+so they are valid and constant, and their size is controlled by the number of characters requested.
+
+The shapes stress one path of the parser each, and grow linearly with the requested size:
+    nested      parantheses nested as deep as the expression is long
+    functions   function calls nested inside each other
+    conditions  if nested in the branches of if
+    literal     a single numeric literal, its leading digits in the range of double
+    integer     a literal with a long integer part, out of the range of double
+    exponent    a long sum ending in a literal written with an exponent out of the range of double, 1e400
+    fraction    a literal with a long fractional part and no leading digits, below the range of double
+    whitespace  a few tokens separated by long runs of whitespace
+    sum         a long flat chain of operators
+*/
+
+#pragma once
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class ExpressionGenerator {
+private:
+    mt19937_64 engine;
+
+    int uniform(int n) {
+        return uniform_int_distribution<int>(0, n - 1)(engine);
+    }
+
+    string number();
+
+    // Appends a term of about size characters
+    void term(string & result, int size, int depth);
+
+    // Appends terms joined by operators until the expression has about size characters
+    void expression(string & result, int size, int depth);
+public:
+    explicit ExpressionGenerator (unsigned long long seed) : engine(seed) {;}
+
+    // Names of the shapes accepted by shape()
+    static vector<string> shapes();
+
+    // Random valid expression of about size characters
+    string random(int size);
+
+    // Expression of the given shape of about size characters
+    string shape(const string & name, int size);
+};
+
+//////////////////////////////////////////////////////////////
+
+string ExpressionGenerator::number() {
+    string result = to_string(1 + uniform(99));
+    if (uniform(3) == 0) {
+        result += "." + to_string(uniform(1000));
+    }
+    return result;
+}
+
+void ExpressionGenerator::term(string & result, int size, int depth) {
+    // Deep enough expressions end in numbers, which keeps the recursion of the generator bounded
+    if (size < 8 || depth > 32) {
+        result += number();
+        return;
+    }
+
+    switch (uniform(6)) {
+        case 0:
+            result += "-";
+            term(result, size - 1, depth + 1);
+            break;
+        case 1:
+            result += "(";
+            expression(result, size - 2, depth + 1);
+            result += ")";
+            break;
+        case 2: {
+            const char * functions[] = {"sin", "cos", "log"};
+            result += functions[uniform(3)];
+            // log is only defined on positive numbers
+            result += "(1 + pow(";
+            expression(result, size - 16, depth + 1);
+            result += ", 2))";
+            break;
+        }
+        case 3:
+            result += uniform(2) ? "max(" : "min(";
+            expression(result, size / 2 - 3, depth + 1);
+            result += ", ";
+            expression(result, size / 2 - 3, depth + 1);
+            result += ")";
+            break;
+        case 4: {
+            const char * comparisons[] = {" < ", " > ", " <= ", " >= ", " == ", " != "};
+            result += "if(";
+            expression(result, size / 6, depth + 1);
+            result += comparisons[uniform(6)];
+            expression(result, size / 6, depth + 1);
+            result += ", ";
+            expression(result, size / 3 - 6, depth + 1);
+            result += ", ";
+            expression(result, size / 3 - 6, depth + 1);
+            result += ")";
+            break;
+        }
+        default:
+            result += number();
+    }
+}
+
+void ExpressionGenerator::expression(string & result, int size, int depth) {
+    const char * operators[] = {" + ", " - ", " * ", "+", "-", "*"};
+
+    int end = result.size() + max(size, 1);
+    int nr_terms = 1 + uniform(4);
+    for (int i = 0; i < nr_terms && (int)result.size() < end; ++i) {
+        if (i > 0) {
+            result += operators[uniform(6)];
+        }
+        term(result, (end - (int)result.size()) / (nr_terms - i), depth);
+    }
+}
+
+vector<string> ExpressionGenerator::shapes() {
+    return {"random", "nested", "functions", "conditions", "literal", "integer", "exponent", "fraction", "whitespace", "sum"};
+}
+
+string ExpressionGenerator::random(int size) {
+    string result;
+    expression(result, size, 0);
+    return result;
+}
+
+string ExpressionGenerator::shape(const string & name, int size) {
+    string result;
+    if (name == "random") {
+        result = random(size);
+        while ((int)result.size() < size) {
+            result += " + " + random(size - result.size());
+        }
+    } else if (name == "nested") {
+        int depth = size / 6;
+        result = string(depth, '(') + "1";
+        for (int i = 0; i < depth; ++i) {
+            result += uniform(2) ? "+1)" : "*1)";
+        }
+    } else if (name == "functions") {
+        int depth = size / 10;
+        for (int i = 0; i < depth; ++i) {
+            result += uniform(2) ? "max(1, " : "min(2, ";
+        }
+        result += "1.5" + string(depth, ')');
+    } else if (name == "conditions") {
+        // The nested if is the taken branch, either the first or the second
+        int depth = size / 16;
+        vector<bool> first(depth);
+        for (int i = 0; i < depth; ++i) {
+            first[i] = uniform(2);
+            result += first[i] ? "if(1 < 2, " : "if(2 < 1, 3, ";
+        }
+        result += "1";
+        for (int i = depth - 1; i >= 0; --i) {
+            result += first[i] ? ", 4)" : ")";
+        }
+    } else if (name == "literal") {
+        result = "12345.";
+        while ((int)result.size() < size) {
+            result += char('0' + uniform(10));
+        }
+        result += " + 1";
+    } else if (name == "integer") {
+        result = "1";
+        while ((int)result.size() < size) {
+            result += char('0' + uniform(10));
+        }
+        result += " + 1";
+    } else if (name == "exponent") {
+        result = number();
+        while ((int)result.size() < size) {
+            result += " + " + number();
+        }
+        result += " + 1e400";
+    } else if (name == "fraction") {
+        result = "0." + string(max(size - 3, 1), '0') + "1 + 1";
+    } else if (name == "whitespace") {
+        const char whitespace[] = {' ', '\t', '\n', '\r'};
+        result = "1";
+        while ((int)result.size() < size) {
+            for (int i = 0; i < size / 4; ++i) {
+                result += whitespace[uniform(4)];
+            }
+            result += "+ 1";
+        }
+    } else if (name == "sum") {
+        result = number();
+        while ((int)result.size() < size) {
+            result += " + " + number();
+        }
+    } else {
+        throw string("Unknown shape " + name);
+    }
+    return result;
+}
@@ -0,0 +1,323 @@
+/*
+Mathematical kernels with selectable accuracy tiers:
+    ACCURACY_EXACT  the scalar libm routines
+    ACCURACY_1ULP   Cody-Waite range reduction and the polynomial kernels of fdlibm for sin / cos, within 1 ulp of libm,
+                    and libm for log, exp and pow
+    ACCURACY_FAST   truncated Taylor series for sin / cos, exp and log (atanh series), without tables,
+                    relative error below 1e-7
+
+The kernels are branch free so that loops over arrays of values can be vectorized by the compiler.
+Arguments outside the range supported by a kernel (huge, negative, infinite or NaN values) are
+computed using libm instead.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "Polynomial.h"
+
+using namespace std;
+
+enum MathAccuracy {ACCURACY_EXACT, ACCURACY_1ULP, ACCURACY_FAST};
+
+// Adding and substracting this constant rounds a double of magnitude below 2^51 to the nearest integer
+#define ROUNDING_CONSTANT 6755399441055744.0
+
+// Largest argument for which the sin / cos range reductions are accurate
+#define TRIG_1ULP_MAX_ARGUMENT 1.6e6
+#define TRIG_FAST_MAX_ARGUMENT 1e5
+
+#define EXP_MAX_ARGUMENT 708.0
+
+// Values of the array kernels of pow computed at once, their exponents are kept on the stack
+#define MATH_POW_BLOCK 256
+
+inline uint64_t double_to_bits(double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+inline double bits_to_double(uint64_t bits) {
+    double x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+// Number of representable doubles between a and b
+inline uint64_t ulp_distance(double a, double b) {
+    if (a == b) {
+        return 0;
+    }
+    if (isnan(a) || isnan(b)) {
+        return UINT64_MAX;
+    }
+
+    // Map the doubles onto integers which are ordered the same way
+    int64_t ia = double_to_bits(a), ib = double_to_bits(b);
+    if (ia < 0) ia = INT64_MIN - ia;
+    if (ib < 0) ib = INT64_MIN - ib;
+    return ia > ib ? uint64_t(ia) - uint64_t(ib) : uint64_t(ib) - uint64_t(ia);
+}
+
+//////////////////////////////////////////
+//  sin / cos
+//////////////////////////////////////////
+
+// sin(x + y) on [-pi/4, pi/4], y being the tail of x
+inline double kernel_sin_1ulp(double x, double y) {
+    const double S1 = -1.66666666666666324348e-01, S2 = 8.33333333332248946124e-03,
+                 S3 = -1.98412698298579493134e-04, S4 = 2.75573137070700676789e-06,
+                 S5 = -2.50507602534068634195e-08, S6 = 1.58969099521155010221e-10;
+    double z = x * x;
+    double v = z * x;
+    double r = S2 + z * (S3 + z * (S4 + z * (S5 + z * S6)));
+    return x - ((z * (0.5 * y - v * r) - y) - v * S1);
+}
+
+// cos(x + y) on [-pi/4, pi/4], y being the tail of x
+inline double kernel_cos_1ulp(double x, double y) {
+    const double C1 = 4.16666666666666019037e-02, C2 = -1.38888888888741095749e-03,
+                 C3 = 2.48015872894767294178e-05, C4 = -2.75573143513906633035e-07,
+                 C5 = 2.08757232129817482790e-09, C6 = -1.13596475577881948265e-11;
+    double z = x * x;
+    double w = z * z;
+    double r = z * (C1 + z * (C2 + z * C3)) + w * w * (C4 + z * (C5 + z * C6));
+    double hz = 0.5 * z;
+    w = 1.0 - hz;
+    return w + (((1.0 - w) - hz) + (z * r - x * y));
+}
+
+// Computes x - quadrant * pi / 2 as y0 + y1 using three parts of pi / 2 (Cody-Waite)
+inline int64_t reduce_1ulp(double x, double & y0, double & y1) {
+    const double invpio2 = 6.36619772367581382433e-01,
+                 pio2_1 = 1.57079632673412561417e+00, pio2_2 = 6.07710050630396597660e-11,
+                 pio2_2t = 2.02226624879595063154e-21, pio2_3 = 2.02226624871116645580e-21,
+                 pio2_3t = 8.47842766036889956997e-32;
+    double t = x * invpio2 + ROUNDING_CONSTANT;
+    int64_t quadrant = double_to_bits(t);
+    double fn = t - ROUNDING_CONSTANT;
+
+    double r = x - fn * pio2_1;
+    double w = fn * pio2_2;
+    double u = r;
+    r = u - w;
+    w = fn * pio2_2t - ((u - r) - w);
+    u = r;
+    double w3 = fn * pio2_3;
+    r = u - w3;
+    w = fn * pio2_3t - ((u - r) - w3);
+
+    y0 = r - w;
+    y1 = (r - y0) - w;
+    return quadrant;
+}
+
+// Selects a for odd quadrants and b for even ones, and flips the sign when bit 1 of the quadrant is set.
+// Written with bit masks so that loops over the kernels have no control flow and can be vectorized.
+inline double select_quadrant(double a, double b, int64_t quadrant, int64_t sign_quadrant) {
+    uint64_t odd = -uint64_t(quadrant & 1);
+    uint64_t bits = (double_to_bits(a) & odd) | (double_to_bits(b) & ~odd);
+    return bits_to_double(bits ^ (uint64_t(sign_quadrant & 2) << 62));
+}
+
+inline double sin_1ulp(double x) {
+    double y0, y1;
+    int64_t quadrant = reduce_1ulp(x, y0, y1);
+    double s = kernel_sin_1ulp(y0, y1), c = kernel_cos_1ulp(y0, y1);
+    return select_quadrant(c, s, quadrant, quadrant);
+}
+
+inline double cos_1ulp(double x) {
+    double y0, y1;
+    int64_t quadrant = reduce_1ulp(x, y0, y1);
+    double s = kernel_sin_1ulp(y0, y1), c = kernel_cos_1ulp(y0, y1);
+    return select_quadrant(s, c, quadrant, quadrant + 1);
+}
+
+// Computes x - quadrant * pi / 2 using three parts of pi / 2: the first two have 33 bits, so their products with
+// the quadrant are exact, and near the multiples of pi the rounding of the last product stays small relative to y
+inline int64_t reduce_fast(double x, double & y) {
+    const double invpio2 = 6.36619772367581382433e-01,
+                 pio2_1 = 1.57079632673412561417e+00, pio2_2 = 6.07710050630396597660e-11,
+                 pio2_2t = 2.02226624879595063154e-21;
+    double t = x * invpio2 + ROUNDING_CONSTANT;
+    double fn = t - ROUNDING_CONSTANT;
+    y = ((x - fn * pio2_1) - fn * pio2_2) - fn * pio2_2t;
+    return double_to_bits(t);
+}
+
+inline double kernel_sin_fast(double x) {
+    double z = x * x;
+    return x + x * z * (-1.0 / 6 + z * (1.0 / 120 + z * (-1.0 / 5040 + z * (1.0 / 362880))));
+}
+
+inline double kernel_cos_fast(double x) {
+    double z = x * x;
+    return 1.0 + z * (-1.0 / 2 + z * (1.0 / 24 + z * (-1.0 / 720 + z * (1.0 / 40320))));
+}
+
+inline double sin_fast(double x) {
+    double y;
+    int64_t quadrant = reduce_fast(x, y);
+    double s = kernel_sin_fast(y), c = kernel_cos_fast(y);
+    return select_quadrant(c, s, quadrant, quadrant);
+}
+
+inline double cos_fast(double x) {
+    double y;
+    int64_t quadrant = reduce_fast(x, y);
+    double s = kernel_sin_fast(y), c = kernel_cos_fast(y);
+    return select_quadrant(s, c, quadrant, quadrant + 1);
+}
+
+//////////////////////////////////////////
+//  log / exp
+//////////////////////////////////////////
+
+// log(x) = k ln2 + 2 atanh(s) with s = (m - 1) / (m + 1), m = x / 2^k in [sqrt(2) / 2, sqrt(2)) and |s| < 0.172.
+// The exponent is extracted with integer additions and shifts, which SSE2 has for vectors of 64 bit integers.
+inline double log_fast(double x) {
+    const double ln2 = 6.93147180559945286227e-01;
+    uint64_t bits = double_to_bits(x);
+    // Adding the bits of 1 minus those of sqrt(2) / 2 carries into the exponent when the mantissa is at least sqrt(2)
+    uint64_t exponent = (bits + 0x00095f619980c433ULL) >> 52;
+    double m = bits_to_double(bits - (exponent << 52) + 0x3ff0000000000000ULL);
+    // k as a double without an integer conversion, which SSE2 lacks
+    double k = bits_to_double(exponent | 0x4330000000000000ULL) - (4503599627370496.0 + 1023);
+
+    double f = m - 1.0;
+    double s = f / (2.0 + f);
+    double z = s * s;
+    return k * ln2 + 2 * s * (1.0 + z * (1.0 / 3 + z * (1.0 / 5 + z * (1.0 / 7 + z * (1.0 / 9)))));
+}
+
+// exp(x) = 2^k exp(r) with |r| <= ln2 / 2, exp(r) by its Taylor polynomial of degree 7
+inline double exp_fast(double x) {
+    const double invln2 = 1.44269504088896338700e+00,
+                 ln2_hi = 6.93147180369123816490e-01, ln2_lo = 1.90821492927058770002e-10;
+    double t = x * invln2 + ROUNDING_CONSTANT;
+    double fk = t - ROUNDING_CONSTANT;
+    double r = (x - fk * ln2_hi) - fk * ln2_lo;
+    double p = 1.0 + r * (1.0 + r * (1.0 / 2 + r * (1.0 / 6 + r * (1.0 / 24 + r * (1.0 / 120 +
+               r * (1.0 / 720 + r * (1.0 / 5040)))))));
+    // The low bits of t hold k, which is added to the exponent of p
+    return bits_to_double(double_to_bits(p) + ((double_to_bits(t) - double_to_bits(ROUNDING_CONSTANT)) << 52));
+}
+
+//////////////////////////////////////////
+//  Dispatch on the accuracy tier
+//////////////////////////////////////////
+
+inline bool is_small_argument(double x, double limit) {
+    return abs(x) < limit;
+}
+
+inline bool is_log_argument(double x) {
+    return x >= 2.2250738585072014e-308 && x <= 1.7976931348623157e308;
+}
+
+inline value_type math_sin(value_type x, MathAccuracy accuracy) {
+    if (accuracy == ACCURACY_1ULP && is_small_argument(x, TRIG_1ULP_MAX_ARGUMENT)) {
+        return sin_1ulp(x);
+    } else if (accuracy == ACCURACY_FAST && is_small_argument(x, TRIG_FAST_MAX_ARGUMENT)) {
+        return sin_fast(x);
+    }
+    return sin(x);
+}
+
+inline value_type math_cos(value_type x, MathAccuracy accuracy) {
+    if (accuracy == ACCURACY_1ULP && is_small_argument(x, TRIG_1ULP_MAX_ARGUMENT)) {
+        return cos_1ulp(x);
+    } else if (accuracy == ACCURACY_FAST && is_small_argument(x, TRIG_FAST_MAX_ARGUMENT)) {
+        return cos_fast(x);
+    }
+    return cos(x);
+}
+
+// glibc log, exp and pow are table driven and already within 1 ulp, so ACCURACY_1ULP uses them:
+// the fdlibm kernels were slower on every machine measured
+inline value_type math_log(value_type x, MathAccuracy accuracy) {
+    if (accuracy == ACCURACY_FAST && is_log_argument(x)) {
+        return log_fast(x);
+    }
+    return log(x);
+}
+
+inline value_type math_exp(value_type x, MathAccuracy accuracy) {
+    if (accuracy == ACCURACY_FAST && is_small_argument(x, EXP_MAX_ARGUMENT)) {
+        return exp_fast(x);
+    }
+    return exp(x);
+}
+
+inline value_type math_pow(value_type x, value_type y, MathAccuracy accuracy) {
+    if (accuracy == ACCURACY_FAST && is_log_argument(x)) {
+        value_type exponent = y * log_fast(x);
+        if (is_small_argument(exponent, EXP_MAX_ARGUMENT)) {
+            return exp_fast(exponent);
+        }
+    }
+    return pow(x, y);
+}
+
+//////////////////////////////////////////
+//  Kernels over arrays of values
+//////////////////////////////////////////
+
+// The first loop only uses the branch free kernels and is vectorizable,
+// the second one recomputes the arguments out of the range of the kernels
+#define MATH_ARRAY_KERNEL(name, kernel_1ulp, kernel_fast, in_range_1ulp, in_range_fast, libm) \
+    inline void name(const value_type * x, value_type * result, int n, MathAccuracy accuracy) { \
+        if (accuracy == ACCURACY_1ULP) { \
+            for (int i = 0; i < n; ++i) \
+                result[i] = kernel_1ulp(x[i]); \
+            for (int i = 0; i < n; ++i) \
+                if (!(in_range_1ulp)) \
+                    result[i] = libm(x[i]); \
+        } else if (accuracy == ACCURACY_FAST) { \
+            for (int i = 0; i < n; ++i) \
+                result[i] = kernel_fast(x[i]); \
+            for (int i = 0; i < n; ++i) \
+                if (!(in_range_fast)) \
+                    result[i] = libm(x[i]); \
+        } else { \
+            for (int i = 0; i < n; ++i) \
+                result[i] = libm(x[i]); \
+        } \
+    }
+
+MATH_ARRAY_KERNEL(math_sin, sin_1ulp, sin_fast, is_small_argument(x[i], TRIG_1ULP_MAX_ARGUMENT),
+                  is_small_argument(x[i], TRIG_FAST_MAX_ARGUMENT), sin)
+MATH_ARRAY_KERNEL(math_cos, cos_1ulp, cos_fast, is_small_argument(x[i], TRIG_1ULP_MAX_ARGUMENT),
+                  is_small_argument(x[i], TRIG_FAST_MAX_ARGUMENT), cos)
+MATH_ARRAY_KERNEL(math_log, log, log_fast, true, is_log_argument(x[i]), log)
+MATH_ARRAY_KERNEL(math_exp, exp, exp_fast, true, is_small_argument(x[i], EXP_MAX_ARGUMENT), exp)
+
+#undef MATH_ARRAY_KERNEL
+
+// Same structure as the other array kernels, the exponents decide which values are recomputed
+inline void math_pow(const value_type * x, const value_type * y, value_type * result, int n, MathAccuracy accuracy) {
+    if (accuracy != ACCURACY_FAST) {
+        for (int i = 0; i < n; ++i)
+            result[i] = pow(x[i], y[i]);
+        return;
+    }
+
+    value_type exponent[MATH_POW_BLOCK];
+    for (int begin = 0; begin < n; begin += MATH_POW_BLOCK) {
+        int size = min(n - begin, MATH_POW_BLOCK);
+        const value_type * bx = x + begin, * by = y + begin;
+        value_type * bresult = result + begin;
+        for (int i = 0; i < size; ++i) {
+            exponent[i] = by[i] * log_fast(bx[i]);
+            bresult[i] = exp_fast(exponent[i]);
+        }
+        for (int i = 0; i < size; ++i)
+            if (!is_log_argument(bx[i]) || !is_small_argument(exponent[i], EXP_MAX_ARGUMENT))
+                bresult[i] = pow(bx[i], by[i]);
+    }
+}
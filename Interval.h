@@ -0,0 +1,245 @@
+/*
+Interval arithmetic with outward rounding
+
+An Interval encloses all the values an expression can take while its variables range over intervals.
+Every bound computed in floating point is rounded outward, by one ulp after the arithmetic operations, which
+are correctly rounded, and by INTERVAL_LIBM_ULPS ulps after the libm functions, which are accurate within 1 ulp.
+The enclosures hold whatever the rounding errors, the accuracy tiers of FastMath.h are not used.
+
+The empty interval has no values. It results from a function applied outside of its domain.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include "Polynomial.h"
+
+using namespace std;
+
+#define INTERVAL_LIBM_ULPS 2
+
+// Beyond this magnitude sin and cos are enclosed by [-1, 1], the multiples of pi being too far apart from 2 pi k
+#define INTERVAL_TRIG_MAX_ARGUMENT 1e9
+
+struct Interval {
+    value_type lo, hi;
+
+    Interval () : lo(0), hi(0) {;}
+    Interval (value_type value) : lo(value), hi(value) {;}
+    Interval (value_type _lo, value_type _hi) : lo(_lo), hi(_hi) {;}
+
+    static Interval empty() {
+        return Interval(INFINITY, -INFINITY);
+    }
+
+    static Interval entire() {
+        return Interval(-INFINITY, INFINITY);
+    }
+
+    bool is_empty() const {
+        return lo > hi;
+    }
+
+    bool contains(value_type value) const {
+        return lo <= value && value <= hi;
+    }
+
+    value_type width() const {
+        return hi - lo;
+    }
+
+    value_type middle() const {
+        return lo + (hi - lo) / 2;
+    }
+};
+
+// Rounds the bounds of an enclosure computed in floating point outward, NaN bounds become infinite
+inline Interval round_outward(value_type lo, value_type hi, int ulps = 1) {
+    if (isnan(lo) || isnan(hi)) {
+        return Interval::entire();
+    }
+    for (int k = 0; k < ulps; ++k) {
+        lo = nextafter(lo, -INFINITY);
+        hi = nextafter(hi, INFINITY);
+    }
+    return Interval(lo, hi);
+}
+
+// Encloses four values, such as the products of the bounds of two intervals
+inline Interval enclose(value_type a, value_type b, value_type c, value_type d, int ulps = 1) {
+    return round_outward(min(min(a, b), min(c, d)), max(max(a, b), max(c, d)), ulps);
+}
+
+inline Interval hull(const Interval & a, const Interval & b) {
+    if (a.is_empty())
+        return b;
+    if (b.is_empty())
+        return a;
+    return Interval(min(a.lo, b.lo), max(a.hi, b.hi));
+}
+
+inline Interval intersect(const Interval & a, const Interval & b) {
+    Interval result(max(a.lo, b.lo), min(a.hi, b.hi));
+    return result.is_empty() ? Interval::empty() : result;
+}
+
+//////////////////////////////////////////
+//  Arithmetic
+//////////////////////////////////////////
+
+inline Interval operator + (const Interval & a, const Interval & b) {
+    if (a.is_empty() || b.is_empty())
+        return Interval::empty();
+    return round_outward(a.lo + b.lo, a.hi + b.hi);
+}
+
+inline Interval operator - (const Interval & a, const Interval & b) {
+    if (a.is_empty() || b.is_empty())
+        return Interval::empty();
+    return round_outward(a.lo - b.hi, a.hi - b.lo);
+}
+
+inline Interval operator - (const Interval & a) {
+    return a.is_empty() ? a : Interval(-a.hi, -a.lo);
+}
+
+inline Interval operator * (const Interval & a, const Interval & b) {
+    if (a.is_empty() || b.is_empty())
+        return Interval::empty();
+    return enclose(a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi);
+}
+
+// The divisor must not contain 0
+inline Interval interval_divide(const Interval & a, const Interval & b) {
+    if (a.is_empty() || b.is_empty())
+        return Interval::empty();
+    return enclose(a.lo / b.lo, a.lo / b.hi, a.hi / b.lo, a.hi / b.hi);
+}
+
+inline Interval interval_max(const Interval & a, const Interval & b) {
+    if (a.is_empty() || b.is_empty())
+        return Interval::empty();
+    return Interval(max(a.lo, b.lo), max(a.hi, b.hi));
+}
+
+inline Interval interval_min(const Interval & a, const Interval & b) {
+    if (a.is_empty() || b.is_empty())
+        return Interval::empty();
+    return Interval(min(a.lo, b.lo), min(a.hi, b.hi));
+}
+
+//////////////////////////////////////////
+//  Comparisons, 1 if they hold for all the values, 0 if they hold for none and [0, 1] otherwise
+//////////////////////////////////////////
+
+inline Interval truth(bool always, bool never) {
+    return always ? Interval(1) : never ? Interval(0) : Interval(0, 1);
+}
+
+inline Interval compare_bounds(const Interval & a, const Interval & b, less<value_type>) {
+    return truth(a.hi < b.lo, a.lo >= b.hi);
+}
+
+inline Interval compare_bounds(const Interval & a, const Interval & b, greater<value_type>) {
+    return truth(a.lo > b.hi, a.hi <= b.lo);
+}
+
+inline Interval compare_bounds(const Interval & a, const Interval & b, less_equal<value_type>) {
+    return truth(a.hi <= b.lo, a.lo > b.hi);
+}
+
+inline Interval compare_bounds(const Interval & a, const Interval & b, greater_equal<value_type>) {
+    return truth(a.lo >= b.hi, a.hi < b.lo);
+}
+
+inline Interval compare_bounds(const Interval & a, const Interval & b, equal_to<value_type>) {
+    return truth(a.lo == a.hi && b.lo == b.hi && a.lo == b.lo, a.hi < b.lo || b.hi < a.lo);
+}
+
+inline Interval compare_bounds(const Interval & a, const Interval & b, not_equal_to<value_type>) {
+    return truth(a.hi < b.lo || b.hi < a.lo, a.lo == a.hi && b.lo == b.hi && a.lo == b.lo);
+}
+
+// A comparison with an operand outside of its domain has no value either, it is neither true nor false
+template <class Compare>
+inline Interval interval_compare(const Interval & a, const Interval & b, Compare compare) {
+    if (a.is_empty() || b.is_empty())
+        return Interval::empty();
+    return compare_bounds(a, b, compare);
+}
+
+//////////////////////////////////////////
+//  Mathematical functions
+//////////////////////////////////////////
+
+// The argument must be positive
+inline Interval interval_log(const Interval & a) {
+    if (a.is_empty())
+        return a;
+    return round_outward(log(a.lo), log(a.hi), INTERVAL_LIBM_ULPS);
+}
+
+// Whether a contains offset + 2 pi k for some integer k, points slightly outside of a count as well
+// since pi is rounded
+inline bool contains_period_point(const Interval & a, value_type offset) {
+    value_type slack = 1e-9 * (1 + max(abs(a.lo), abs(a.hi)));
+    return floor((a.hi + slack - offset) / (2 * M_PI)) >= ceil((a.lo - slack - offset) / (2 * M_PI));
+}
+
+// Encloses sin or cos given the offsets of their maximum and minimum in the period
+inline Interval interval_periodic(const Interval & a, value_type (*function)(value_type),
+                                  value_type maximum_offset, value_type minimum_offset) {
+    if (a.is_empty())
+        return a;
+    if (!(a.width() < 2 * M_PI) || max(abs(a.lo), abs(a.hi)) > INTERVAL_TRIG_MAX_ARGUMENT)
+        return Interval(-1, 1);
+
+    value_type at_lo = function(a.lo), at_hi = function(a.hi);
+    Interval result = round_outward(min(at_lo, at_hi), max(at_lo, at_hi), INTERVAL_LIBM_ULPS);
+    if (contains_period_point(a, maximum_offset))
+        result.hi = 1;
+    if (contains_period_point(a, minimum_offset))
+        result.lo = -1;
+    return intersect(result, Interval(-1, 1));
+}
+
+inline Interval interval_sin(const Interval & a) {
+    return interval_periodic(a, sin, M_PI / 2, -M_PI / 2);
+}
+
+inline Interval interval_cos(const Interval & a) {
+    return interval_periodic(a, cos, 0, M_PI);
+}
+
+// On non-negative bases pow is non-negative and monotonous in each argument, so its extremes over a box are at the corners
+inline Interval interval_pow_nonnegative(const Interval & a, const Interval & b) {
+    if (a.is_empty() || b.is_empty())
+        return Interval::empty();
+    Interval corners = enclose(pow(a.lo, b.lo), pow(a.lo, b.hi), pow(a.hi, b.lo), pow(a.hi, b.hi), INTERVAL_LIBM_ULPS);
+    return intersect(corners, Interval(0, INFINITY));
+}
+
+// Negative bases are only in the domain of the integer exponents, those of b are enclosed
+inline Interval interval_pow(const Interval & a, const Interval & b) {
+    if (a.is_empty() || b.is_empty())
+        return Interval::empty();
+
+    Interval non_negative = a.hi >= 0 ? Interval(a.lo > 0 ? a.lo : 0, a.hi) : Interval::empty();
+    Interval result = interval_pow_nonnegative(non_negative, b);
+
+    Interval integers(ceil(b.lo), floor(b.hi));
+    if (a.lo < 0 && integers.lo <= integers.hi) {
+        // pow(x, n) = pow(-x, n) for even n and -pow(-x, n) for odd n, both signs occur once b holds two integers
+        Interval negative = interval_pow_nonnegative(Interval(a.hi < 0 ? -a.hi : 0, -a.lo), integers);
+        if (integers.lo < integers.hi) {
+            result = hull(result, hull(negative, -negative));
+        } else {
+            result = hull(result, fmod(integers.lo, 2) != 0 ? -negative : negative);
+        }
+    }
+
+    return result;
+}
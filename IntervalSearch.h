@@ -0,0 +1,262 @@
+/*
+Branch-and-bound search over an expression in one variable, evaluated in interval arithmetic
+
+The range [a, b] is bisected level by level. The expression is evaluated once over every box of a level, which
+encloses its values on all the points of the box, and the boxes which can't contain a root, or a value above the
+best one found so far, are discarded as a whole. The boxes of a level are evaluated in parallel and the bounds
+are only updated between levels, so the result does not depend on the number of threads.
+
+Every root, and every point where the maximum is reached, lies in one of the enclosures found.
+The conditionals evaluate both branches when their condition is not decided over a box.
+*/
+
+#pragma once
+
+#include "Node.h"
+#include "Parallel.h"
+
+#define INTERVAL_TOLERANCE 1e-9
+// Near a smooth extremum the enclosures overestimate the values by about the width of the boxes,
+// so the boxes within the square root of the tolerance from the extremum are all refined
+#define INTERVAL_EXTREMUM_TOLERANCE 1e-6
+// Boxes of a level above which they are not bisected any further
+#define INTERVAL_MAX_BOXES (1 << 16)
+// Minimum number of boxes evaluated by a thread
+#define INTERVAL_MIN_BOXES_PER_THREAD 256
+
+struct RootEnclosures {
+    // Disjoint intervals in increasing order, every root is in one of them
+    vector<Interval> roots;
+    // Evaluations of the expression over a box
+    long long evaluations;
+    // False if the search stopped at INTERVAL_MAX_BOXES boxes before the enclosures were narrow enough
+    bool converged;
+};
+
+struct ExtremumEnclosure {
+    // Encloses the maximum, or the minimum
+    Interval value;
+    // Disjoint intervals in increasing order, every point where the extremum is reached is in one of them
+    vector<Interval> locations;
+    long long evaluations;
+    bool converged;
+};
+
+class IntervalSearch {
+private:
+    // Program in one variable, its aggregates already reduced
+    const Program & program;
+
+    // Evaluates a program on the stack, above the intermediate results of the enclosing programs
+    static Interval evaluate(const Program & program, const Interval & x, vector<Interval> & stack);
+
+    // Evaluates the expression over every box, negated when minimizing
+    void evaluate_all(const vector<Interval> & boxes, vector<Interval> & values, bool negate) const;
+
+    static void check_range(value_type a, value_type b, value_type tolerance);
+
+    // Sorts the enclosures and merges the ones which overlap or touch
+    static vector<Interval> merge(vector<Interval> enclosures);
+
+    static bool can_bisect(const Interval & box, value_type tolerance) {
+        return box.width() > tolerance && box.lo < box.middle() && box.middle() < box.hi;
+    }
+
+    ExtremumEnclosure find_extremum(value_type a, value_type b, value_type tolerance, bool minimum) const;
+public:
+    explicit IntervalSearch (const Program & _program) : program(_program) {;}
+
+    Interval evaluate(const Interval & x) const;
+
+    // Encloses the roots in [a, b] in intervals at most tolerance wide
+    RootEnclosures find_roots(value_type a, value_type b, value_type tolerance = INTERVAL_TOLERANCE) const;
+
+    // Boxes are refined until they are at most tolerance wide or their values can't exceed the best one by more
+    ExtremumEnclosure find_maximum(value_type a, value_type b, value_type tolerance = INTERVAL_EXTREMUM_TOLERANCE) const {
+        return find_extremum(a, b, tolerance, false);
+    }
+
+    ExtremumEnclosure find_minimum(value_type a, value_type b, value_type tolerance = INTERVAL_EXTREMUM_TOLERANCE) const {
+        return find_extremum(a, b, tolerance, true);
+    }
+};
+
+//////////////////////////////////////////////////////////////
+
+Interval IntervalSearch::evaluate(const Program & program, const Interval & x, vector<Interval> & stack) {
+    unsigned int base = stack.size();
+
+    for (const auto & node : program) {
+        if (node->get_type() == NODE_SCALAR) {
+            const Scalar * current_scalar = dynamic_cast<const Scalar*>(node.get());
+            stack.push_back(current_scalar->is_variable() ? x : Interval(current_scalar->get_constant()));
+        } else if (node->get_type() == NODE_CONDITIONAL) {
+            const FunctionIf * conditional = dynamic_cast<const FunctionIf*>(node.get());
+            Interval condition = evaluate(conditional->get_argument(0), x, stack);
+            Interval result = Interval::empty();
+            if (!condition.is_empty() && (condition.lo != 0 || condition.hi != 0)) {
+                result = evaluate(conditional->get_argument(1), x, stack);
+            }
+            if (condition.contains(0)) {
+                result = hull(result, evaluate(conditional->get_argument(2), x, stack));
+            }
+            stack.push_back(result);
+        } else {
+            const Function * current_function = dynamic_cast<const Function*>(node.get());
+            int first_operand = stack.size() - current_function->get_arity();
+            Interval result = current_function->apply_interval(&stack[first_operand]);
+            stack.resize(first_operand);
+            stack.push_back(result);
+        }
+    }
+
+    Interval result = stack.back();
+    stack.resize(base);
+    return result;
+}
+
+Interval IntervalSearch::evaluate(const Interval & x) const {
+    vector<Interval> stack;
+    return evaluate(program, x, stack);
+}
+
+void IntervalSearch::evaluate_all(const vector<Interval> & boxes, vector<Interval> & values, bool negate) const {
+    values.resize(boxes.size());
+    parallel_for(0, boxes.size(), INTERVAL_MIN_BOXES_PER_THREAD, [&](int begin, int end) {
+        vector<Interval> stack;
+        for (int i = begin; i < end; ++i) {
+            values[i] = evaluate(program, boxes[i], stack);
+            if (negate) {
+                values[i] = -values[i];
+            }
+        }
+    });
+}
+
+void IntervalSearch::check_range(value_type a, value_type b, value_type tolerance) {
+    if (!(a <= b) || !isfinite(a) || !isfinite(b)) {
+        throw string("Invalid range, it must be finite and its lower bound can't exceed its upper bound");
+    }
+    if (!(tolerance >= 0)) {
+        throw string("The tolerance can't be negative");
+    }
+}
+
+vector<Interval> IntervalSearch::merge(vector<Interval> enclosures) {
+    sort(enclosures.begin(), enclosures.end(), [](const Interval & first, const Interval & second) {
+        return first.lo < second.lo;
+    });
+
+    vector<Interval> result;
+    for (const auto & enclosure : enclosures) {
+        if (!result.empty() && enclosure.lo <= result.back().hi) {
+            result.back().hi = max(result.back().hi, enclosure.hi);
+        } else {
+            result.push_back(enclosure);
+        }
+    }
+    return result;
+}
+
+RootEnclosures IntervalSearch::find_roots(value_type a, value_type b, value_type tolerance) const {
+    check_range(a, b, tolerance);
+
+    RootEnclosures result;
+    result.evaluations = 0;
+    result.converged = true;
+
+    vector<Interval> boxes = {Interval(a, b)}, values, roots;
+    while (!boxes.empty()) {
+        evaluate_all(boxes, values, false);
+        result.evaluations += boxes.size();
+
+        bool bisect = boxes.size() <= INTERVAL_MAX_BOXES;
+        vector<Interval> next_boxes;
+        for (unsigned int i = 0; i < boxes.size(); ++i) {
+            if (!values[i].contains(0)) {
+                continue;
+            }
+
+            bool narrow = !can_bisect(boxes[i], tolerance);
+            if (narrow || !bisect) {
+                result.converged = result.converged && narrow;
+                roots.push_back(boxes[i]);
+            } else {
+                value_type middle = boxes[i].middle();
+                next_boxes.push_back(Interval(boxes[i].lo, middle));
+                next_boxes.push_back(Interval(middle, boxes[i].hi));
+            }
+        }
+        boxes = move(next_boxes);
+    }
+
+    result.roots = merge(move(roots));
+    return result;
+}
+
+ExtremumEnclosure IntervalSearch::find_extremum(value_type a, value_type b, value_type tolerance, bool minimum) const {
+    check_range(a, b, tolerance);
+
+    ExtremumEnclosure result;
+    result.evaluations = 0;
+    result.converged = true;
+
+    // The value at any point is a lower bound of the maximum
+    value_type best = -INFINITY;
+
+    vector<Interval> boxes = {Interval(a, b)}, values, middles, middle_values;
+    vector<Interval> locations, location_values;
+    while (!boxes.empty()) {
+        middles.resize(boxes.size());
+        for (unsigned int i = 0; i < boxes.size(); ++i) {
+            middles[i] = Interval(boxes[i].middle());
+        }
+        evaluate_all(boxes, values, minimum);
+        evaluate_all(middles, middle_values, minimum);
+        result.evaluations += 2 * boxes.size();
+
+        for (const auto & value : middle_values) {
+            if (!value.is_empty()) {
+                best = max(best, value.lo);
+            }
+        }
+
+        bool bisect = boxes.size() <= INTERVAL_MAX_BOXES;
+        vector<Interval> next_boxes;
+        for (unsigned int i = 0; i < boxes.size(); ++i) {
+            if (values[i].is_empty() || values[i].hi < best) {
+                continue;
+            }
+
+            bool narrow = !can_bisect(boxes[i], tolerance) || values[i].hi - best <= tolerance;
+            if (narrow || !bisect) {
+                result.converged = result.converged && narrow;
+                locations.push_back(boxes[i]);
+                location_values.push_back(values[i]);
+            } else {
+                value_type middle = boxes[i].middle();
+                next_boxes.push_back(Interval(boxes[i].lo, middle));
+                next_boxes.push_back(Interval(middle, boxes[i].hi));
+            }
+        }
+        boxes = move(next_boxes);
+    }
+
+    // The best value may have grown since the first locations were found
+    vector<Interval> kept;
+    value_type upper_bound = -INFINITY;
+    for (unsigned int i = 0; i < locations.size(); ++i) {
+        if (location_values[i].hi >= best) {
+            kept.push_back(locations[i]);
+            upper_bound = max(upper_bound, location_values[i].hi);
+        }
+    }
+
+    if (kept.empty()) {
+        throw string("The expression has no value on the range");
+    }
+
+    result.value = minimum ? Interval(-upper_bound, -best) : Interval(best, upper_bound);
+    result.locations = merge(move(kept));
+    return result;
+}
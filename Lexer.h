@@ -0,0 +1,259 @@
+/*
+Tokenizer reading an expression from a stream
+
+The characters are read in chunks of LEXER_CHUNK_SIZE and only the unread part of the buffer is kept,
+so an expression of any length is tokenized in memory bounded by the chunk size and the longest token.
+Tokens are produced one at a time by next(), with their names interned in the symbol table
+and their numbers already parsed.
+
+FileDescriptorBuffer adapts a file descriptor, such as the standard input, to a stream.
+*/
+
+#pragma once
+
+#include <cerrno>
+#include <istream>
+#include <stdexcept>
+#include <streambuf>
+#include <unistd.h>
+
+#include "Node.h"
+
+#define LEFT_PARANTHESES '('
+#define RIGHT_PARANTHESES ')'
+#define COMMA ','
+#define EQUAL_SIGN '='
+#define MINUS_SIGN '-'
+
+#define LEXER_CHUNK_SIZE 65536
+
+class FileDescriptorBuffer : public streambuf {
+private:
+    int fd;
+    vector<char> chunk;
+protected:
+    int_type underflow() override;
+public:
+    explicit FileDescriptorBuffer (int _fd) : fd(_fd), chunk(LEXER_CHUNK_SIZE) {;}
+};
+
+class Lexer {
+private:
+    istream & input;
+    SymbolTable & symbols;
+
+    // Characters read from the input, the ones before position are consumed
+    string buffer;
+    unsigned int position;
+
+    // A minus sign is a negation unless it follows an operand
+    bool expect_operator;
+
+    // A number directly followed by a name is a multiplication, as in "2a"
+    bool pending_multiplication;
+
+    // Returns the character at the given offset from the position, EOF at the end of the input
+    int peek(unsigned int offset = 0);
+
+    string take(unsigned int length);
+
+    static int get_operator_symbol(int c);
+
+    // Line breaks are whitespace, so expressions can be read from text files
+    static bool is_whitespace(int c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    // Parses a floating point number starting at the position and returns its length
+    unsigned int parse_number();
+public:
+    Lexer (istream & _input, SymbolTable & _symbols) :
+            input(_input), symbols(_symbols), position(0), expect_operator(false), pending_multiplication(false) {;}
+
+    // Reads the next token, returns false at the end of the input
+    bool next(Token & token);
+};
+
+//////////////////////////////////////////////////////////////
+
+FileDescriptorBuffer::int_type FileDescriptorBuffer::underflow() {
+    ssize_t nr_read;
+    do {
+        nr_read = read(fd, chunk.data(), chunk.size());
+    } while (nr_read < 0 && errno == EINTR);
+
+    if (nr_read <= 0) {
+        return traits_type::eof();
+    }
+
+    setg(chunk.data(), chunk.data(), chunk.data() + nr_read);
+    return traits_type::to_int_type(chunk[0]);
+}
+
+int Lexer::peek(unsigned int offset) {
+    while (position + offset >= buffer.size()) {
+        // Drop the consumed characters before growing the buffer, keeping the cost linear
+        if (position > 0) {
+            buffer.erase(0, position);
+            position = 0;
+        }
+
+        unsigned int size = buffer.size();
+        buffer.resize(size + LEXER_CHUNK_SIZE);
+        input.read(&buffer[size], LEXER_CHUNK_SIZE);
+        buffer.resize(size + input.gcount());
+
+        if (input.gcount() == 0) {
+            return EOF;
+        }
+    }
+
+    return (unsigned char)buffer[position + offset];
+}
+
+string Lexer::take(unsigned int length) {
+    string result = buffer.substr(position, length);
+    position += length;
+    return result;
+}
+
+int Lexer::get_operator_symbol(int c) {
+    if (c == '+')
+        return SYMBOL_ADD;
+    else if (c == '-')
+        return SYMBOL_SUBSTRACT;
+    else if (c == '*')
+        return SYMBOL_MULTIPLY;
+    else if (c == '/')
+        return SYMBOL_DIVIDE;
+    else
+        return NO_SYMBOL;
+}
+
+unsigned int Lexer::parse_number() {
+    unsigned int j = 1;
+    int number_dots = 0;
+    while (peek(j) != EOF) {
+        if (peek(j) == LEFT_PARANTHESES) {
+            throw string("Invalid floating number: contains invalid characters");
+        } else if (!isdigit(peek(j)) && peek(j) != '.') {
+            break;
+        }
+
+        number_dots += peek(j) == '.';
+        ++j;
+    }
+
+    if (number_dots > 1) {
+        throw string("Invalid floating number: too many dots");
+    }
+
+    return j;
+}
+
+bool Lexer::next(Token & token) {
+    if (pending_multiplication) {
+        pending_multiplication = false;
+        token = Token (TOKEN_OPERATOR, SYMBOL_MULTIPLY);
+        return true;
+    }
+
+    int c = peek();
+    if (c == EOF) {
+        return false;
+    }
+
+    if (is_whitespace(c)) {
+        // whitespace, a whole run at once
+        unsigned int j = 1;
+        while (is_whitespace(peek(j))) {
+            ++j;
+        }
+        position += j;
+        token = Token (TOKEN_WHITESPACE);
+    } else if (c == COMMA) {
+        // comma
+        ++position;
+        token = Token (TOKEN_COMMA);
+    } else if (isdigit(c)) {
+        // number
+        string number = take(parse_number());
+        try {
+            token = Token (TOKEN_NUMBER, NO_SYMBOL, stod(number));
+        } catch (out_of_range &) {
+            throw string("Invalid floating number: out of the range of double");
+        } catch (invalid_argument &) {
+            throw string("Invalid floating number");
+        }
+        pending_multiplication = peek() != EOF && isalpha(peek());
+    } else if (isalpha(c)) {
+        // function or variable
+        unsigned int j = 1;
+        while (peek(j) != EOF && isalpha(peek(j))) {
+            ++j;
+        }
+
+        if (peek(j) != EOF && (isdigit(peek(j)) || peek(j) == '.')) {
+            throw string("Invalid function definition");
+        }
+
+        // Known functions and names followed by parantheses are functions, everything else is a variable
+        unsigned int k = j;
+        while (is_whitespace(peek(k))) {
+            ++k;
+        }
+
+        bool followed_by_parantheses = peek(k) == LEFT_PARANTHESES;
+
+        int symbol = symbols.intern(take(j));
+
+        if (FunctionFactory::is_function(symbol) || followed_by_parantheses) {
+            token = Token (TOKEN_FUNCTION, symbol);
+        } else {
+            token = Token (TOKEN_VARIABLE, symbol);
+        }
+    } else if (c == LEFT_PARANTHESES) {
+        // (
+        ++position;
+        token = Token (TOKEN_LEFT_PARANTHESES);
+    } else if (c == RIGHT_PARANTHESES) {
+        // )
+        ++position;
+        token = Token (TOKEN_RIGHT_PARANTHESES);
+    } else if (c == EQUAL_SIGN && peek(1) != EQUAL_SIGN) {
+        // =, the equal sign of an equation
+        ++position;
+        token = Token (TOKEN_EQUAL_SIGN);
+    } else if (c == '<' || c == '>' || ((c == EQUAL_SIGN || c == '!') && peek(1) == EQUAL_SIGN)) {
+        // comparison
+        bool or_equal = peek(1) == EQUAL_SIGN;
+        position += 1 + or_equal;
+        if (c == EQUAL_SIGN) {
+            token = Token (TOKEN_OPERATOR, SYMBOL_EQUAL);
+        } else if (c == '!') {
+            token = Token (TOKEN_OPERATOR, SYMBOL_NOT_EQUAL);
+        } else if (c == '<') {
+            token = Token (TOKEN_OPERATOR, or_equal ? SYMBOL_LESS_EQUAL : SYMBOL_LESS);
+        } else {
+            token = Token (TOKEN_OPERATOR, or_equal ? SYMBOL_GREATER_EQUAL : SYMBOL_GREATER);
+        }
+    } else if (c == MINUS_SIGN && !expect_operator) {
+        // negation sign
+        ++position;
+        token = Token (TOKEN_OPERATOR, SYMBOL_NEGATE);
+    } else if (get_operator_symbol(c) != NO_SYMBOL) {
+        // operator
+        ++position;
+        token = Token (TOKEN_OPERATOR, get_operator_symbol(c));
+    } else {
+        throw string("Invalid operator");
+    }
+
+    if (token.token_type == TOKEN_RIGHT_PARANTHESES || token.token_type == TOKEN_NUMBER || token.token_type == TOKEN_VARIABLE) {
+        expect_operator = true;
+    } else if (token.token_type != TOKEN_WHITESPACE) {
+        expect_operator = false;
+    }
+
+    return true;
+}
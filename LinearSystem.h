@@ -0,0 +1,274 @@
+/*
+Dense system of linear equations A * x = b
+Square systems are solved using a cache-blocked LU decomposition with partial pivoting.
+The trailing matrix updates of large systems are split across threads.
+Singular and non-square systems are classified by comparing the ranks of A and [A | b].
+*/
+
+#pragma once
+
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Parallel.h"
+#include "Polynomial.h"
+
+using namespace std;
+
+#define LINEAR_SYSTEM_EPS 1e-9
+#define LU_BLOCK_SIZE 64
+#define LU_COLUMN_BLOCK_SIZE 256
+#define LU_PARALLEL_MIN_ROWS 64
+
+// Row-major matrix stored in a single contiguous buffer
+class Matrix {
+private:
+    int nr_rows, nr_columns;
+    vector<value_type> data;
+public:
+    Matrix (int _nr_rows, int _nr_columns) : nr_rows(_nr_rows), nr_columns(_nr_columns), data(_nr_rows * _nr_columns) {;}
+
+    int rows() const {
+        return nr_rows;
+    }
+
+    int columns() const {
+        return nr_columns;
+    }
+
+    value_type * row(int i) {
+        return &data[i * nr_columns];
+    }
+
+    const value_type * row(int i) const {
+        return &data[i * nr_columns];
+    }
+
+    value_type & operator() (int i, int j) {
+        return data[i * nr_columns + j];
+    }
+
+    value_type operator() (int i, int j) const {
+        return data[i * nr_columns + j];
+    }
+
+    void swap_rows(int i, int j) {
+        swap_ranges(row(i), row(i) + nr_columns, row(j));
+    }
+};
+
+class LinearSystem {
+private:
+    Matrix coefficients;
+    vector<value_type> constants;
+
+    value_type tolerance() const {
+        value_type scale = 0;
+        for (int i = 0; i < coefficients.rows(); ++i)
+            for (int j = 0; j < coefficients.columns(); ++j)
+                scale = max(scale, abs(coefficients(i, j)));
+        return LINEAR_SYSTEM_EPS * max(scale, value_type(1));
+    }
+
+    // Factorizes a in place into P * a = L * U, L having a unit diagonal
+    // Returns false if a pivot smaller than the tolerance is found
+    static bool lu_decompose(Matrix & a, vector<int> & pivots, value_type eps);
+
+    // Solves L * U * x = P * b using a factorization computed by lu_decompose
+    static vector<value_type> lu_solve(const Matrix & lu, const vector<int> & pivots, vector<value_type> b);
+
+    // Reduces [A | b] to row echelon form in order to report why no unique solution exists
+    // Returns the solution when it is unique (only possible for overdetermined systems)
+    vector<value_type> solve_by_elimination(value_type eps) const;
+public:
+    LinearSystem (int nr_equations, int nr_unknowns) : coefficients(nr_equations, nr_unknowns), constants(nr_equations) {;}
+
+    int nr_equations() const {
+        return coefficients.rows();
+    }
+
+    int nr_unknowns() const {
+        return coefficients.columns();
+    }
+
+    // Row of coefficients of an equation, stored contiguously
+    value_type * equation(int i) {
+        return coefficients.row(i);
+    }
+
+    value_type & constant(int i) {
+        return constants[i];
+    }
+
+    vector<value_type> solve() const;
+};
+
+//////////////////////////////////////////////////////////////
+
+bool LinearSystem::lu_decompose(Matrix & a, vector<int> & pivots, value_type eps) {
+    int n = a.rows();
+    pivots.resize(n);
+
+    for (int k0 = 0; k0 < n; k0 += LU_BLOCK_SIZE) {
+        int k1 = min(k0 + LU_BLOCK_SIZE, n);
+
+        // Factorize the panel made of columns [k0, k1)
+        for (int k = k0; k < k1; ++k) {
+            int pivot = k;
+            for (int i = k + 1; i < n; ++i) {
+                if (abs(a(i, k)) > abs(a(pivot, k))) {
+                    pivot = i;
+                }
+            }
+
+            if (abs(a(pivot, k)) < eps) {
+                return false;
+            }
+
+            pivots[k] = pivot;
+            if (pivot != k) {
+                a.swap_rows(pivot, k);
+            }
+
+            const value_type * row_k = a.row(k);
+            for (int i = k + 1; i < n; ++i) {
+                value_type * row_i = a.row(i);
+                row_i[k] /= row_k[k];
+                value_type l = row_i[k];
+                for (int j = k + 1; j < k1; ++j)
+                    row_i[j] -= l * row_k[j];
+            }
+        }
+
+        if (k1 == n) {
+            break;
+        }
+
+        // U12 = inverse(L11) * A12
+        for (int k = k0; k < k1; ++k) {
+            const value_type * row_k = a.row(k);
+            for (int i = k + 1; i < k1; ++i) {
+                value_type * row_i = a.row(i);
+                value_type l = row_i[k];
+                for (int j = k1; j < n; ++j)
+                    row_i[j] -= l * row_k[j];
+            }
+        }
+
+        // A22 -= L21 * U12, one block of columns at a time so that the U12 block stays in cache
+        parallel_for(k1, n, LU_PARALLEL_MIN_ROWS, [&a, k0, k1, n](int row_begin, int row_end) {
+            for (int j0 = k1; j0 < n; j0 += LU_COLUMN_BLOCK_SIZE) {
+                int j1 = min(j0 + LU_COLUMN_BLOCK_SIZE, n);
+                for (int i = row_begin; i < row_end; ++i) {
+                    value_type * row_i = a.row(i);
+                    for (int k = k0; k < k1; ++k) {
+                        value_type l = row_i[k];
+                        const value_type * row_k = a.row(k);
+                        for (int j = j0; j < j1; ++j)
+                            row_i[j] -= l * row_k[j];
+                    }
+                }
+            }
+        });
+    }
+
+    return true;
+}
+
+vector<value_type> LinearSystem::lu_solve(const Matrix & lu, const vector<int> & pivots, vector<value_type> b) {
+    int n = lu.rows();
+
+    for (int i = 0; i < n; ++i)
+        swap(b[i], b[pivots[i]]);
+
+    for (int i = 0; i < n; ++i) {
+        const value_type * row_i = lu.row(i);
+        for (int j = 0; j < i; ++j)
+            b[i] -= row_i[j] * b[j];
+    }
+
+    for (int i = n - 1; i >= 0; --i) {
+        const value_type * row_i = lu.row(i);
+        for (int j = i + 1; j < n; ++j)
+            b[i] -= row_i[j] * b[j];
+        b[i] /= row_i[i];
+    }
+
+    return b;
+}
+
+vector<value_type> LinearSystem::solve_by_elimination(value_type eps) const {
+    int m = nr_equations(), n = nr_unknowns();
+
+    Matrix augmented(m, n + 1);
+    for (int i = 0; i < m; ++i) {
+        copy(coefficients.row(i), coefficients.row(i) + n, augmented.row(i));
+        augmented(i, n) = constants[i];
+    }
+
+    // Gauss-Jordan elimination with partial pivoting
+    int rank = 0;
+    vector<int> pivot_columns;
+    for (int j = 0; j < n && rank < m; ++j) {
+        int pivot = rank;
+        for (int i = rank + 1; i < m; ++i) {
+            if (abs(augmented(i, j)) > abs(augmented(pivot, j))) {
+                pivot = i;
+            }
+        }
+
+        if (abs(augmented(pivot, j)) < eps) {
+            continue;
+        }
+
+        augmented.swap_rows(pivot, rank);
+        value_type * row_rank = augmented.row(rank);
+        for (int k = n; k >= j; --k)
+            row_rank[k] /= row_rank[j];
+
+        for (int i = 0; i < m; ++i) {
+            if (i != rank) {
+                value_type * row_i = augmented.row(i);
+                value_type l = row_i[j];
+                for (int k = j; k <= n; ++k)
+                    row_i[k] -= l * row_rank[k];
+            }
+        }
+
+        pivot_columns.push_back(j);
+        ++rank;
+    }
+
+    for (int i = rank; i < m; ++i) {
+        if (abs(augmented(i, n)) >= eps) {
+            throw string ("System is inconsistent, no solutions");
+        }
+    }
+
+    if (rank < n) {
+        stringstream ss;
+        ss << "System has " << rank << " independent equations for " << n << " unknowns, infinite number of solutions";
+        throw ss.str();
+    }
+
+    vector<value_type> solution(n);
+    for (int i = 0; i < rank; ++i)
+        solution[pivot_columns[i]] = augmented(i, n);
+    return solution;
+}
+
+vector<value_type> LinearSystem::solve() const {
+    value_type eps = tolerance();
+
+    if (nr_equations() == nr_unknowns()) {
+        Matrix lu = coefficients;
+        vector<int> pivots;
+        if (lu_decompose(lu, pivots, eps)) {
+            return lu_solve(lu, pivots, constants);
+        }
+    }
+
+    return solve_by_elimination(eps);
+}
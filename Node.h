@@ -11,9 +11,19 @@
     In order to add another function:
 
     (1) Define a new FunctioncFUNC class derived from Function
-    (2) Add the relevant code in the FunctionFactory class
+    (2) Add its symbol to BuiltinSymbol and its name to SymbolTable::builtin_name
+    (3) Add the relevant code in the FunctionFactory class
+
+    Aggregate functions (sum, mean, dot) are evaluated over columns of values bound to variables.
+    Their arguments are captured as separate RPN programs which are evaluated a chunk of rows at a time.
+    The arguments of if are captured the same way, so that only the branch chosen by the condition is evaluated.
+
+    Every function also encloses its values over intervals of operands, see Interval.h. Operands outside of
+    the domain of the function, for which apply_value throws, are left out of the enclosure.
 */
 
+#pragma once
+
 #include <cstdio>
 #include <iostream>
 #include <algorithm>
@@ -24,33 +34,41 @@
 #include <queue>
 #include <stack>
 
+#include <functional>
 #include <memory>
+#include <type_traits>
 #include <string>
 #include <vector>
 
 #include "Polynomial.h"
+#include "FastMath.h"
+#include "Interval.h"
+#include "SymbolTable.h"
 
 using namespace std;
 
 enum TokenType {TOKEN_WHITESPACE, TOKEN_COMMA, TOKEN_NUMBER, TOKEN_OPERATOR, TOKEN_FUNCTION, TOKEN_LEFT_PARANTHESES,
                 TOKEN_RIGHT_PARANTHESES, TOKEN_VARIABLE, TOKEN_EQUAL_SIGN};
 
-enum NodeType {NODE_SCALAR, NODE_FUNCTION};
+enum NodeType {NODE_SCALAR, NODE_FUNCTION, NODE_COLUMN, NODE_AGGREGATE, NODE_CONDITIONAL};
 
 #define EPS 1e-6
 
 typedef Polynomial scalar;
 
+// Identifiers are interned in the SymbolTable of the calculator and numbers are parsed once by the tokenizer
 struct Token {
-    string identifier;
-    double value;
     TokenType token_type;
-    Token() {;}
-    Token (const string & _indentifier, const TokenType _token_type) {
-        identifier = _indentifier, token_type = _token_type;    
+    int symbol;
+    value_type value;
+    Token() = default;
+    Token (const TokenType _token_type, int _symbol = NO_SYMBOL, value_type _value = 0) {
+        token_type = _token_type, symbol = _symbol, value = _value;
     }
 };
 
+static_assert(is_trivial<Token>::value && is_standard_layout<Token>::value && sizeof(Token) == 16, "Tokens are 16 byte plain old data");
+
 //////////////////////////////////////////
 //  Node abstract base class
 //////////////////////////////////////////
@@ -58,18 +76,15 @@ struct Token {
 class AbstractNode {
 protected:
     NodeType type;
-    int precedence;
-    string identifier;
+    // Symbol of the identifier, NO_SYMBOL for numbers
+    int symbol;
 public:
     virtual ~AbstractNode () {;}
-    NodeType get_type() {
+    NodeType get_type() const {
         return type;
     }
-    int get_precedence() {
-        return precedence;
-    }
-    string get_identifier() {
-        return identifier;
+    int get_symbol() const {
+        return symbol;
     }
 };
 
@@ -80,28 +95,69 @@ public:
 class Function : public AbstractNode {    
 protected:
     int arity;
+    int precedence;
+    // Accuracy tier of the mathematical kernels used by the function
+    MathAccuracy accuracy;
+    // Estimated cost of an application, relative to an addition
+    int cost;
     void check_arity(int num_scalars) const {
         if (num_scalars != arity) {
-            throw string("Invalid number of parameters for " + identifier);
+            throw string("Invalid number of parameters for " + get_identifier());
         }
     }
     void check_constants(const vector<scalar> & scalars) const {
         for (const auto & value : scalars) {
             if (!value.is_constant()) {
-                throw string("Can't use " + identifier + " on polynomials of degree >= 2");    
+                throw string("Can't use " + get_identifier() + " on polynomials of degree >= 2");    
             }
         }
     }
 public:
     virtual scalar apply(const vector<scalar> & scalars) const = 0;
 
+    // Applies the function on constants
+    virtual value_type apply_value(const value_type * operands) const = 0;
+
+    // Encloses the values of the function over intervals of operands
+    virtual Interval apply_interval(const Interval * operands) const = 0;
+
+    // Applies the function on n rows of constants, operands[k] being the column of the k-th operand
+    virtual void apply_batch(const value_type * const * operands, value_type * result, int n) const {
+        vector<value_type> row(arity);
+        for (int i = 0; i < n; ++i) {
+            for (int k = 0; k < arity; ++k)
+                row[k] = operands[k][i];
+            result[i] = apply_value(row.data());
+        }
+    }
+
     Function () {
         type = NODE_FUNCTION;
+        precedence = 0;
+        accuracy = ACCURACY_EXACT;
+        cost = 1;
+    }
+
+    // Functions are built-in, so their names are not kept in the table of the calculator
+    const string & get_identifier() const {
+        return SymbolTable::builtin_name(symbol);
+    }
+
+    int get_precedence() const {
+        return precedence;
     }
 
-    int get_arity() {
+    int get_arity() const {
         return arity;
     }
+
+    int get_cost() const {
+        return cost;
+    }
+
+    void set_accuracy(MathAccuracy _accuracy) {
+        accuracy = _accuracy;
+    }
 };
 
 //////////////////////////////////////////
@@ -113,12 +169,22 @@ public:
     FunctionAdd () {
         arity = 2;
         precedence = 1;
-        identifier = "+";
+        symbol = SYMBOL_ADD;
     }
     scalar apply(const vector<scalar> & scalars) const {
         check_arity (scalars.size());
         return scalars[0] + scalars[1];
     }
+    value_type apply_value(const value_type * operands) const {
+        return operands[0] + operands[1];
+    }
+    Interval apply_interval(const Interval * operands) const {
+        return operands[0] + operands[1];
+    }
+    void apply_batch(const value_type * const * operands, value_type * result, int n) const {
+        for (int i = 0; i < n; ++i)
+            result[i] = operands[0][i] + operands[1][i];
+    }
 };
 
 class FunctionSubstract: public Function {
@@ -126,12 +192,22 @@ public:
     FunctionSubstract () {
         arity = 2;
         precedence = 1;
-        identifier = "-";
+        symbol = SYMBOL_SUBSTRACT;
     }
     scalar apply(const vector<scalar> & scalars) const {
         check_arity (scalars.size());
         return scalars[0] - scalars[1];
     }
+    value_type apply_value(const value_type * operands) const {
+        return operands[0] - operands[1];
+    }
+    Interval apply_interval(const Interval * operands) const {
+        return operands[0] - operands[1];
+    }
+    void apply_batch(const value_type * const * operands, value_type * result, int n) const {
+        for (int i = 0; i < n; ++i)
+            result[i] = operands[0][i] - operands[1][i];
+    }
 };
 
 class FunctionMultiply: public Function {
@@ -139,12 +215,22 @@ public:
     FunctionMultiply () {
         arity = 2;
         precedence = 2;
-        identifier = "*";
+        symbol = SYMBOL_MULTIPLY;
     }
     scalar apply(const vector<scalar> & scalars) const {
         check_arity (scalars.size());
         return scalars[0] * scalars[1];
     }
+    value_type apply_value(const value_type * operands) const {
+        return operands[0] * operands[1];
+    }
+    Interval apply_interval(const Interval * operands) const {
+        return operands[0] * operands[1];
+    }
+    void apply_batch(const value_type * const * operands, value_type * result, int n) const {
+        for (int i = 0; i < n; ++i)
+            result[i] = operands[0][i] * operands[1][i];
+    }
 };
 
 class FunctionDivide: public Function {
@@ -152,12 +238,33 @@ public:
     FunctionDivide () {
         arity = 2;
         precedence = 2;
-        identifier = "/";
+        symbol = SYMBOL_DIVIDE;
     }
     scalar apply(const vector<scalar> & scalars) const {
         check_arity (scalars.size());
         return scalars[0] / scalars[1];
     }
+    value_type apply_value(const value_type * operands) const {
+        check_divisor(operands[1]);
+        return operands[0] / operands[1];
+    }
+    Interval apply_interval(const Interval * operands) const {
+        // The divisors closer to 0 than POLYNOMIAL_EPS are not in the domain
+        Interval negative = intersect(operands[1], Interval(-INFINITY, -POLYNOMIAL_EPS));
+        Interval positive = intersect(operands[1], Interval(POLYNOMIAL_EPS, INFINITY));
+        return hull(interval_divide(operands[0], negative), interval_divide(operands[0], positive));
+    }
+    void apply_batch(const value_type * const * operands, value_type * result, int n) const {
+        for (int i = 0; i < n; ++i)
+            check_divisor(operands[1][i]);
+        for (int i = 0; i < n; ++i)
+            result[i] = operands[0][i] / operands[1][i];
+    }
+    void check_divisor(value_type divisor) const {
+        if (abs(divisor) < POLYNOMIAL_EPS) {
+            throw string ("Can't divide polynomial by 0");
+        }
+    }
 };
 
 class FunctionNegate: public Function {
@@ -165,14 +272,58 @@ public:
     FunctionNegate () {
         arity = 1;
         precedence = 10;
-        identifier = "~";
+        symbol = SYMBOL_NEGATE;
     }
     scalar apply(const vector<scalar> & scalars) const {
         check_arity (scalars.size());
         return Polynomial(-1) * scalars[0];
     }
+    value_type apply_value(const value_type * operands) const {
+        return -operands[0];
+    }
+    Interval apply_interval(const Interval * operands) const {
+        return -operands[0];
+    }
+    void apply_batch(const value_type * const * operands, value_type * result, int n) const {
+        for (int i = 0; i < n; ++i)
+            result[i] = -operands[0][i];
+    }
 };
 
+// The comparisons are 1 when true and 0 when false
+template <int comparison_symbol, class Compare>
+class FunctionComparison: public Function {
+public:
+    FunctionComparison () {
+        arity = 2;
+        precedence = 0;
+        symbol = comparison_symbol;
+    }
+    scalar apply(const vector<scalar> & scalars) const {
+        check_arity (scalars.size());
+        check_constants(scalars);
+        return scalar(Compare()(scalars[0].get_0(), scalars[1].get_0()));
+    }
+    value_type apply_value(const value_type * operands) const {
+        return Compare()(operands[0], operands[1]);
+    }
+    Interval apply_interval(const Interval * operands) const {
+        return interval_compare(operands[0], operands[1], Compare());
+    }
+    void apply_batch(const value_type * const * operands, value_type * result, int n) const {
+        Compare compare;
+        for (int i = 0; i < n; ++i)
+            result[i] = compare(operands[0][i], operands[1][i]);
+    }
+};
+
+typedef FunctionComparison<SYMBOL_LESS, less<value_type>> FunctionLess;
+typedef FunctionComparison<SYMBOL_GREATER, greater<value_type>> FunctionGreater;
+typedef FunctionComparison<SYMBOL_LESS_EQUAL, less_equal<value_type>> FunctionLessEqual;
+typedef FunctionComparison<SYMBOL_GREATER_EQUAL, greater_equal<value_type>> FunctionGreaterEqual;
+typedef FunctionComparison<SYMBOL_EQUAL, equal_to<value_type>> FunctionEqual;
+typedef FunctionComparison<SYMBOL_NOT_EQUAL, not_equal_to<value_type>> FunctionNotEqual;
+
 //////////////////////////////////////////
 //  Mathematical functions
 //////////////////////////////////////////
@@ -181,16 +332,32 @@ class FunctionLog: public Function {
 public:
     FunctionLog () {
         arity = 1;
-        identifier = "log";
+        symbol = SYMBOL_LOG;
+        cost = 10;
     }
     scalar apply(const vector<scalar> & scalars) const {
         check_arity (scalars.size());
         check_constants (scalars);
 
-        if (scalars[0].get_0() < EPS) {
+        check_argument(scalars[0].get_0());
+        return scalar(math_log(scalars[0].get_0(), accuracy));
+    }
+    value_type apply_value(const value_type * operands) const {
+        check_argument(operands[0]);
+        return math_log(operands[0], accuracy);
+    }
+    Interval apply_interval(const Interval * operands) const {
+        return interval_log(intersect(operands[0], Interval(EPS, INFINITY)));
+    }
+    void apply_batch(const value_type * const * operands, value_type * result, int n) const {
+        for (int i = 0; i < n; ++i)
+            check_argument(operands[0][i]);
+        math_log(operands[0], result, n, accuracy);
+    }
+    void check_argument(value_type value) const {
+        if (value < EPS) {
             throw string("Can't take logarithm a number less than or equal to 0");
         }
-        return scalar(log(scalars[0].get_0()));
     }
 };
 
@@ -198,7 +365,7 @@ class FunctionMax: public Function {
 public:
     FunctionMax () {
         arity = 2;
-        identifier = "max";
+        symbol = SYMBOL_MAX;
     }
     scalar apply(const vector<scalar> & scalars) const {
         check_arity (scalars.size());
@@ -206,13 +373,23 @@ public:
 
         return scalar(max(scalars[0].get_0(), scalars[1].get_0()));
     }
+    value_type apply_value(const value_type * operands) const {
+        return max(operands[0], operands[1]);
+    }
+    Interval apply_interval(const Interval * operands) const {
+        return interval_max(operands[0], operands[1]);
+    }
+    void apply_batch(const value_type * const * operands, value_type * result, int n) const {
+        for (int i = 0; i < n; ++i)
+            result[i] = max(operands[0][i], operands[1][i]);
+    }
 };
 
 class FunctionMin: public Function {
 public:
     FunctionMin () {
         arity = 2;
-        identifier = "min";
+        symbol = SYMBOL_MIN;
     }
     scalar apply(const vector<scalar> & scalars) const {
         check_arity (scalars.size());
@@ -220,19 +397,39 @@ public:
 
         return scalar(min(scalars[0].get_0(), scalars[1].get_0()));
     }
+    value_type apply_value(const value_type * operands) const {
+        return min(operands[0], operands[1]);
+    }
+    Interval apply_interval(const Interval * operands) const {
+        return interval_min(operands[0], operands[1]);
+    }
+    void apply_batch(const value_type * const * operands, value_type * result, int n) const {
+        for (int i = 0; i < n; ++i)
+            result[i] = min(operands[0][i], operands[1][i]);
+    }
 };
 
 class FunctionPow: public Function {
 public:
     FunctionPow () {
         arity = 2;
-        identifier = "pow";
+        symbol = SYMBOL_POW;
+        cost = 10;
     }
     scalar apply(const vector<scalar> & scalars) const {
         check_arity (scalars.size());
         check_constants(scalars);
 
-        return scalar(pow(scalars[0].get_0(), scalars[1].get_0()));
+        return scalar(math_pow(scalars[0].get_0(), scalars[1].get_0(), accuracy));
+    }
+    value_type apply_value(const value_type * operands) const {
+        return math_pow(operands[0], operands[1], accuracy);
+    }
+    Interval apply_interval(const Interval * operands) const {
+        return interval_pow(operands[0], operands[1]);
+    }
+    void apply_batch(const value_type * const * operands, value_type * result, int n) const {
+        math_pow(operands[0], operands[1], result, n, accuracy);
     }
 };
 
@@ -240,12 +437,22 @@ class FunctionSin: public Function {
 public:
     FunctionSin () {
         arity = 1;
-        identifier = "sin";
+        symbol = SYMBOL_SIN;
+        cost = 10;
     }
     scalar apply(const vector<scalar> & scalars) const {
         check_arity (scalars.size());
         check_constants(scalars);
-        return scalar(sin(scalars[0].get_0()));
+        return scalar(math_sin(scalars[0].get_0(), accuracy));
+    }
+    value_type apply_value(const value_type * operands) const {
+        return math_sin(operands[0], accuracy);
+    }
+    Interval apply_interval(const Interval * operands) const {
+        return interval_sin(operands[0]);
+    }
+    void apply_batch(const value_type * const * operands, value_type * result, int n) const {
+        math_sin(operands[0], result, n, accuracy);
     }
 };
 
@@ -253,12 +460,157 @@ class FunctionCos: public Function {
 public:
     FunctionCos () {
         arity = 1;
-        identifier = "cos";
+        symbol = SYMBOL_COS;
+        cost = 10;
     }
     scalar apply(const vector<scalar> & scalars) const {
         check_arity (scalars.size());
         check_constants(scalars);
-        return scalar(cos(scalars[0].get_0()));
+        return scalar(math_cos(scalars[0].get_0(), accuracy));
+    }
+    value_type apply_value(const value_type * operands) const {
+        return math_cos(operands[0], accuracy);
+    }
+    Interval apply_interval(const Interval * operands) const {
+        return interval_cos(operands[0]);
+    }
+    void apply_batch(const value_type * const * operands, value_type * result, int n) const {
+        math_cos(operands[0], result, n, accuracy);
+    }
+};
+
+//////////////////////////////////////////
+//  Functions evaluating their own arguments
+//////////////////////////////////////////
+
+typedef vector<unique_ptr<AbstractNode>> Program;
+
+class LazyFunction : public Function {
+protected:
+    // RPN programs of the arguments, captured from the output queue once it is built
+    vector<Program> arguments;
+public:
+    void set_arguments(vector<Program> _arguments) {
+        arguments = move(_arguments);
+    }
+
+    const Program & get_argument(int index) const {
+        return arguments[index];
+    }
+
+    Program & get_argument(int index) {
+        return arguments[index];
+    }
+};
+
+// if(condition, a, b) is a when the condition is nonzero and b otherwise, the other branch is not evaluated
+class FunctionIf : public LazyFunction {
+public:
+    FunctionIf () {
+        type = NODE_CONDITIONAL;
+        arity = 3;
+        symbol = SYMBOL_IF;
+    }
+
+    scalar apply(const vector<scalar> &) const {
+        throw string("if can't be applied on evaluated branches");
+    }
+
+    value_type apply_value(const value_type *) const {
+        throw string("if can't be applied on evaluated branches");
+    }
+
+    Interval apply_interval(const Interval *) const {
+        throw string("if can't be applied on evaluated branches");
+    }
+};
+
+//////////////////////////////////////////
+//  Aggregate functions over columns
+//////////////////////////////////////////
+
+class AggregateFunction : public LazyFunction {
+protected:
+    // Result of the last reduction, used when the aggregate is nested in the argument of another one
+    value_type value;
+
+    // Combines the values of the arguments on n rows into the terms which are summed
+    virtual void combine(const value_type * const * values, value_type * terms, int n) const = 0;
+
+    // Computes the result from the sum of the terms over all the rows
+    virtual value_type finish(value_type total, int) const {
+        return total;
+    }
+
+    // Reduces the nested aggregates, which are constant over the rows, and finds the length of the columns
+    void prepare(const Program & program, int & length);
+public:
+    AggregateFunction () {
+        type = NODE_AGGREGATE;
+        cost = 1000;
+        value = 0;
+    }
+
+    scalar apply(const vector<scalar> &) const {
+        throw string(get_identifier() + " must be applied over a bound column");
+    }
+
+    value_type apply_value(const value_type *) const {
+        throw string(get_identifier() + " must be applied over a bound column");
+    }
+
+    Interval apply_interval(const Interval *) const {
+        throw string(get_identifier() + " must be applied over a bound column");
+    }
+
+    value_type get_value() const {
+        return value;
+    }
+
+    // Evaluates the aggregate over the bound columns used by its arguments
+    value_type reduce();
+};
+
+class AggregateSum : public AggregateFunction {
+protected:
+    void combine(const value_type * const * values, value_type * terms, int n) const {
+        copy(values[0], values[0] + n, terms);
+    }
+public:
+    AggregateSum () {
+        arity = 1;
+        symbol = SYMBOL_SUM;
+    }
+};
+
+class AggregateMean : public AggregateFunction {
+protected:
+    void combine(const value_type * const * values, value_type * terms, int n) const {
+        copy(values[0], values[0] + n, terms);
+    }
+    value_type finish(value_type total, int length) const {
+        if (length == 0) {
+            throw string("Can't take the mean of an empty column");
+        }
+        return total / length;
+    }
+public:
+    AggregateMean () {
+        arity = 1;
+        symbol = SYMBOL_MEAN;
+    }
+};
+
+class AggregateDot : public AggregateFunction {
+protected:
+    void combine(const value_type * const * values, value_type * terms, int n) const {
+        for (int i = 0; i < n; ++i)
+            terms[i] = values[0][i] * values[1][i];
+    }
+public:
+    AggregateDot () {
+        arity = 2;
+        symbol = SYMBOL_DOT;
     }
 };
 
@@ -268,62 +620,142 @@ public:
 
 class FunctionFactory {
 public:
-    static unique_ptr<AbstractNode> build(const Token & token) {
+    static bool is_function(int symbol) {
+        return symbol >= SYMBOL_LOG && symbol < NR_BUILTIN_SYMBOLS;
+    }
+
+    static bool is_aggregate(int symbol) {
+        return symbol == SYMBOL_SUM || symbol == SYMBOL_MEAN || symbol == SYMBOL_DOT;
+    }
+
+    // Aggregates and if evaluate their own arguments, which are captured as separate programs
+    static bool is_lazy(int symbol) {
+        return is_aggregate(symbol) || symbol == SYMBOL_IF;
+    }
+
+    static unique_ptr<Function> build(const Token & token, MathAccuracy accuracy) {
+        unique_ptr<Function> node = build(token);
+        node->set_accuracy(accuracy);
+        return node;
+    }
+
+    // Names which are not built-in functions are reported by the caller, which knows them
+    static unique_ptr<Function> build(const Token & token) {
         if (token.token_type == TOKEN_OPERATOR) {
-            if (token.identifier == "+")
+            if (token.symbol == SYMBOL_ADD)
                 return unique_ptr<Function>(new FunctionAdd());
-            else if (token.identifier == "-")
+            else if (token.symbol == SYMBOL_SUBSTRACT)
                 return unique_ptr<Function>(new FunctionSubstract());
-            else if (token.identifier == "*")
+            else if (token.symbol == SYMBOL_MULTIPLY)
                 return unique_ptr<Function>(new FunctionMultiply());
-            else if (token.identifier == "/")
+            else if (token.symbol == SYMBOL_DIVIDE)
                 return unique_ptr<Function>(new FunctionDivide());
-            else if (token.identifier == "~")
+            else if (token.symbol == SYMBOL_NEGATE)
                 return unique_ptr<Function>(new FunctionNegate());
+            else if (token.symbol == SYMBOL_LESS)
+                return unique_ptr<Function>(new FunctionLess());
+            else if (token.symbol == SYMBOL_GREATER)
+                return unique_ptr<Function>(new FunctionGreater());
+            else if (token.symbol == SYMBOL_LESS_EQUAL)
+                return unique_ptr<Function>(new FunctionLessEqual());
+            else if (token.symbol == SYMBOL_GREATER_EQUAL)
+                return unique_ptr<Function>(new FunctionGreaterEqual());
+            else if (token.symbol == SYMBOL_EQUAL)
+                return unique_ptr<Function>(new FunctionEqual());
+            else if (token.symbol == SYMBOL_NOT_EQUAL)
+                return unique_ptr<Function>(new FunctionNotEqual());
             else
-                throw string("Invalid mathematical operator " + token.identifier);
+                throw string("Invalid mathematical operator");
         } else if (token.token_type == TOKEN_FUNCTION) {
-            if (token.identifier == "log")
+            if (token.symbol == SYMBOL_LOG)
                 return unique_ptr<Function>(new FunctionLog());
-            else if (token.identifier == "max")
+            else if (token.symbol == SYMBOL_MAX)
                 return unique_ptr<Function>(new FunctionMax());
-            else if (token.identifier == "min")
+            else if (token.symbol == SYMBOL_MIN)
                 return unique_ptr<Function>(new FunctionMin());
-            else if (token.identifier == "pow")
+            else if (token.symbol == SYMBOL_POW)
                 return unique_ptr<Function>(new FunctionPow());
-            else if (token.identifier == "sin")
+            else if (token.symbol == SYMBOL_SIN)
                 return unique_ptr<Function>(new FunctionSin());
-            else if (token.identifier == "cos")
+            else if (token.symbol == SYMBOL_COS)
                 return unique_ptr<Function>(new FunctionCos());
+            else if (token.symbol == SYMBOL_SUM)
+                return unique_ptr<Function>(new AggregateSum());
+            else if (token.symbol == SYMBOL_MEAN)
+                return unique_ptr<Function>(new AggregateMean());
+            else if (token.symbol == SYMBOL_DOT)
+                return unique_ptr<Function>(new AggregateDot());
+            else if (token.symbol == SYMBOL_IF)
+                return unique_ptr<Function>(new FunctionIf());
             else
-                throw string("Invalid mathematical function " + token.identifier);
+                throw string("Invalid mathematical function");
         }
+        throw string("Invalid token for a function");
     }
 };
 
+// A number, a variable or a variable bound to a constant
 class Scalar : public AbstractNode {
 private:
-    scalar value;
-    void parse(const Token & token) {
+    value_type constant;
+    // Index of the variable, -1 for constants
+    int variable_index;
+public:
+    // A number or a variable
+    Scalar (const Token & token, int _variable_index = -1) {
         if (token.token_type != TOKEN_NUMBER && token.token_type != TOKEN_VARIABLE) {
             throw string("Invalid polynomial value");
         }
 
-        if (token.token_type == TOKEN_NUMBER) {
-            value_type coeff0 = stod(token.identifier);
-            value = Polynomial(coeff0);
-        } else {
-            value = Polynomial("x");
-        }
+        type = NODE_SCALAR;
+        symbol = token.symbol;
+        constant = token.value;
+        variable_index = token.token_type == TOKEN_VARIABLE ? _variable_index : -1;
     }
-public:
-    Scalar (const Token & token) {
+
+    // A variable bound to a constant
+    Scalar (int _symbol, value_type _constant) {
         type = NODE_SCALAR;
-        identifier = token.identifier;
-        parse(token);
+        symbol = _symbol;
+        constant = _constant;
+        variable_index = -1;
     }
 
-    scalar get_value() {
-        return value;
+    scalar get_value() const {
+        return is_variable() ? Polynomial::Variable(variable_index) : Polynomial(constant);
+    }
+
+    bool is_variable() const {
+        return variable_index >= 0;
+    }
+
+    int get_variable_index() const {
+        return variable_index;
+    }
+
+    value_type get_constant() const {
+        return constant;
+    }
+};
+
+// A variable bound to a column of values, only valid inside the arguments of aggregate functions
+class Column : public AbstractNode {
+private:
+    const value_type * values;
+    int length;
+public:
+    Column (int _symbol, const vector<value_type> & column) {
+        type = NODE_COLUMN;
+        symbol = _symbol;
+        values = column.data();
+        length = column.size();
+    }
+
+    const value_type * get_values() const {
+        return values;
+    }
+
+    int get_length() const {
+        return length;
     }
 };
\ No newline at end of file
@@ -0,0 +1,65 @@
+/*
+Minimal data parallelism helpers
+parallel_for splits a range of indices into contiguous parts and runs each part on its own thread.
+Small ranges (less than min_grain indices per thread) are processed on the calling thread.
+An exception thrown by the body is rethrown on the calling thread once all the parts finished.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+inline int hardware_threads() {
+    int nr_threads = thread::hardware_concurrency();
+    return max(nr_threads, 1);
+}
+
+// Calls body(part_begin, part_end) on disjoint parts covering [begin, end)
+inline void parallel_for(int begin, int end, int min_grain, const function<void(int, int)> & body) {
+    int length = end - begin;
+    if (length <= 0) {
+        return;
+    }
+
+    int nr_threads = min(hardware_threads(), max(length / max(min_grain, 1), 1));
+    if (nr_threads == 1) {
+        body(begin, end);
+        return;
+    }
+
+    int part = (length + nr_threads - 1) / nr_threads;
+    int nr_parts = (length + part - 1) / part;
+    vector<exception_ptr> errors(nr_parts);
+
+    auto run_part = [&](int nr_part) {
+        try {
+            body(begin + nr_part * part, min(begin + (nr_part + 1) * part, end));
+        } catch (...) {
+            errors[nr_part] = current_exception();
+        }
+    };
+
+    vector<thread> workers;
+    for (int nr_part = 1; nr_part < nr_parts; ++nr_part) {
+        workers.push_back(thread(run_part, nr_part));
+    }
+
+    // The calling thread processes the first part
+    run_part(0);
+
+    for (auto & worker : workers) {
+        worker.join();
+    }
+
+    for (const auto & error : errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+}
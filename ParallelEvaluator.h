@@ -0,0 +1,228 @@
+/*
+Parallel evaluation of large programs in reverse polish notation
+
+Every subtree of the expression is a contiguous range of the program which ends at its root.
+The evaluator computes the range and the estimated cost of every subtree. As in a heavy-light
+decomposition, the costliest child of a node is evaluated by the same task as the node, while its
+other children whose cost is at least min_task_cost become tasks of their own, so tasks are nested
+at most O(log n) levels deep. A task evaluates its range sequentially, using the results of its
+subtasks in place of their ranges.
+
+Every node is computed from the same operands as in the sequential evaluation, so the result is identical.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <exception>
+
+#include "Node.h"
+#include "Reduction.h"
+#include "TaskScheduler.h"
+
+#define PARALLEL_MIN_TASK_COST 4096
+
+class ParallelEvaluator {
+private:
+    const Program & program;
+    // Used to report errors
+    const SymbolTable & symbols;
+    long long min_task_cost;
+    TaskScheduler & scheduler;
+
+    // First position and estimated cost of the subtree rooted at every position
+    vector<int> starts;
+    vector<long long> costs;
+
+    // Direct subtasks of every task, ordered by position
+    vector<vector<int>> subtasks;
+
+    // Results of the tasks
+    vector<scalar> results;
+    vector<exception_ptr> errors;
+    unique_ptr<atomic<bool>[]> finished;
+
+    // Computes the subtrees and chooses the tasks
+    void analyze();
+
+    void spawn(int task);
+    void run(int task);
+    scalar wait(int task);
+
+    void evaluate_node(AbstractNode * node, vector<scalar> & buffer) const;
+
+    // Evaluates the arguments of if, which are not split into tasks
+    scalar evaluate_sequentially(const Program & argument) const;
+public:
+    ParallelEvaluator (const Program & _program, const SymbolTable & _symbols, long long _min_task_cost, TaskScheduler & _scheduler);
+
+    scalar evaluate();
+};
+
+//////////////////////////////////////////////////////////////
+
+ParallelEvaluator::ParallelEvaluator(const Program & _program, const SymbolTable & _symbols, long long _min_task_cost,
+                                     TaskScheduler & _scheduler) :
+        program(_program), symbols(_symbols), min_task_cost(_min_task_cost), scheduler(_scheduler) {;}
+
+void ParallelEvaluator::analyze() {
+    int n = program.size();
+    starts.resize(n);
+    costs.resize(n);
+    vector<bool> is_task(n);
+
+    vector<int> roots;
+    for (int i = 0; i < n; ++i) {
+        starts[i] = i;
+        costs[i] = 1;
+
+        if (program[i]->get_type() == NODE_FUNCTION) {
+            Function * current_function = dynamic_cast<Function*>(program[i].get());
+            int arity = current_function->get_arity();
+            if ((int)roots.size() < arity) {
+                throw string("Insufficient number of operands for " + current_function->get_identifier());
+            }
+
+            int first_child = roots.size() - arity;
+            int heaviest_child = roots.back();
+            costs[i] = current_function->get_cost();
+            for (int k = first_child; k < (int)roots.size(); ++k) {
+                costs[i] += costs[roots[k]];
+                if (costs[roots[k]] > costs[heaviest_child]) {
+                    heaviest_child = roots[k];
+                }
+            }
+
+            for (int k = first_child; k < (int)roots.size(); ++k) {
+                if (roots[k] != heaviest_child && costs[roots[k]] >= min_task_cost) {
+                    is_task[roots[k]] = true;
+                }
+            }
+
+            if (arity > 0) {
+                starts[i] = starts[roots[first_child]];
+            }
+            roots.resize(first_child);
+        } else if (program[i]->get_type() == NODE_AGGREGATE || program[i]->get_type() == NODE_CONDITIONAL) {
+            costs[i] = dynamic_cast<Function*>(program[i].get())->get_cost();
+        }
+
+        roots.push_back(i);
+    }
+
+    if (roots.size() != 1) {
+        throw string(roots.empty() ? "Insufficient scalars left" : "Too many scalars left");
+    }
+    is_task[n - 1] = true;
+
+    // Scanning the tasks backwards, the open tasks form a chain of nested ranges
+    subtasks.resize(n);
+    vector<int> open_tasks;
+    for (int i = n - 1; i >= 0; --i) {
+        if (!is_task[i]) {
+            continue;
+        }
+
+        while (!open_tasks.empty() && starts[open_tasks.back()] > i) {
+            open_tasks.pop_back();
+        }
+        if (!open_tasks.empty()) {
+            subtasks[open_tasks.back()].push_back(i);
+        }
+        open_tasks.push_back(i);
+    }
+
+    for (auto & tasks : subtasks) {
+        reverse(tasks.begin(), tasks.end());
+    }
+
+    results.resize(n);
+    errors.resize(n);
+    finished.reset(new atomic<bool>[n]);
+    for (int i = 0; i < n; ++i) {
+        finished[i] = false;
+    }
+}
+
+void ParallelEvaluator::spawn(int task) {
+    scheduler.submit([this, task] {
+        try {
+            run(task);
+        } catch (...) {
+            errors[task] = current_exception();
+        }
+        finished[task].store(true, memory_order_release);
+    });
+}
+
+void ParallelEvaluator::run(int task) {
+    const auto & children = subtasks[task];
+    for (int child : children) {
+        spawn(child);
+    }
+
+    try {
+        vector<scalar> buffer;
+        unsigned int next_child = 0;
+        for (int i = starts[task]; i <= task; ++i) {
+            if (next_child < children.size() && starts[children[next_child]] == i) {
+                buffer.push_back(wait(children[next_child]));
+                i = children[next_child++];
+            } else {
+                evaluate_node(program[i].get(), buffer);
+            }
+        }
+        results[task] = buffer.back();
+    } catch (...) {
+        // The subtasks use this evaluator, they must finish before the error is reported
+        for (int child : children) {
+            scheduler.wait_until([this, child] { return finished[child].load(memory_order_acquire); });
+        }
+        throw;
+    }
+}
+
+scalar ParallelEvaluator::wait(int task) {
+    scheduler.wait_until([this, task] { return finished[task].load(memory_order_acquire); });
+    if (errors[task]) {
+        rethrow_exception(errors[task]);
+    }
+    return results[task];
+}
+
+void ParallelEvaluator::evaluate_node(AbstractNode * node, vector<scalar> & buffer) const {
+    if (node->get_type() == NODE_SCALAR) {
+        buffer.push_back(dynamic_cast<Scalar*>(node)->get_value());
+    } else if (node->get_type() == NODE_COLUMN) {
+        throw string("Column " + symbols.name(node->get_symbol()) + " can only be used inside an aggregate function");
+    } else if (node->get_type() == NODE_AGGREGATE) {
+        buffer.push_back(scalar(dynamic_cast<AggregateFunction*>(node)->reduce()));
+    } else if (node->get_type() == NODE_CONDITIONAL) {
+        FunctionIf * conditional = dynamic_cast<FunctionIf*>(node);
+        scalar condition = evaluate_sequentially(conditional->get_argument(0));
+        if (!condition.is_constant()) {
+            throw string("The condition of if can't depend on the variable");
+        }
+        buffer.push_back(evaluate_sequentially(conditional->get_argument(condition.get_0() != 0 ? 1 : 2)));
+    } else {
+        Function * current_function = dynamic_cast<Function*>(node);
+        int first_operand = buffer.size() - current_function->get_arity();
+        vector<scalar> operands(buffer.begin() + first_operand, buffer.end());
+        buffer.resize(first_operand);
+        buffer.push_back(current_function->apply(operands));
+    }
+}
+
+scalar ParallelEvaluator::evaluate_sequentially(const Program & argument) const {
+    vector<scalar> buffer;
+    for (const auto & node : argument) {
+        evaluate_node(node.get(), buffer);
+    }
+    return buffer.back();
+}
+
+scalar ParallelEvaluator::evaluate() {
+    analyze();
+    run(program.size() - 1);
+    return results[program.size() - 1];
+}
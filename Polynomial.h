@@ -1,10 +1,16 @@
 /*
 Standard Polynomial functionality
 Supports addition, substraction, division, multiplication on degree 0 polynomials
-Supports addition, multiplication on degree 1 polynomials
+Supports addition, substraction, multiplication on degree 1 polynomials
 Supports solving for the roots of a degree 1 polynomial
+
+A degree 1 polynomial may also be linear in several variables: coeff[0] is the constant term and
+coeff[i + 1] is the coefficient of the i-th variable. Variable 0 is x.
 */
 
+#pragma once
+
+#include <string>
 #include <vector>
 #include <cmath>
 
@@ -40,6 +46,13 @@ public:
         coeff[1] = 1;
     }
 
+    // The i-th variable
+    static Polynomial Variable(int index) {
+        vector<value_type> values (index + 2);
+        values[index + 1] = 1;
+        return Polynomial (values);
+    }
+
     Polynomial operator- (void) const {
         Polynomial result = *this;
         for (int i = 0; i < degree(); ++i)
@@ -63,14 +76,7 @@ public:
     } 
 
     Polynomial operator- (const Polynomial & right) const {
-        // degree 0 only
-        if (degree() > 1 && right.degree() > 1) {
-            throw string ("Substraction not supported for polynomials of degree >= 1");
-        }
-
-        Polynomial result = *this;
-        result.coeff[0] -= right.coeff[0];
-        return result;
+        return *this + (-right);
     } 
 
     Polynomial operator* (const Polynomial & right) const {
@@ -123,7 +129,7 @@ public:
         return coeff[0];
     }
 
-    vector<value_type> get_coeff() const {
+    const vector<value_type> & get_coeff() const {
         return coeff;
     }
 
@@ -132,8 +138,9 @@ public:
     }
 
     value_type solve_degree_1() const {
-        if (degree() == 0 || abs(coeff[1]) < POLYNOMIAL_EPS) {
-            if (abs(coeff[0]) < POLYNOMIAL_EPS) {
+        // The variable may only appear in a branch which is not taken, leaving a constant
+        if (coeff.size() < 2 || abs(coeff[1]) < POLYNOMIAL_EPS) {
+            if (coeff.empty() || abs(coeff[0]) < POLYNOMIAL_EPS) {
                 throw string ("Expression evaluates to 0, infinite number of solutions");
             } else {
                 throw string ("Constant can't equal 0, no solutions");
@@ -0,0 +1,250 @@
+/*
+Evaluation of aggregate functions over columns of values
+
+The rows are split into chunks of a fixed size. The arguments of the aggregate are evaluated
+on one chunk at a time using the vectorizable Function::apply_batch and the terms of a chunk
+are summed pairwise. Chunks are processed in parallel and their sums are combined in order
+using compensated summation. Since the chunks do not depend on the number of threads,
+neither does the result.
+
+The branches of if are evaluated only on the rows which take them. When the condition is the same
+on all the rows of a chunk, only one branch is evaluated, as is. Otherwise the rows are split by branch:
+every branch is evaluated on its rows only, gathering the values of the columns it reads, and the
+results are scattered back in place.
+*/
+
+#pragma once
+
+#include "Node.h"
+#include "Parallel.h"
+
+#define REDUCTION_CHUNK_SIZE 1024
+#define REDUCTION_MIN_CHUNKS_PER_THREAD 16
+#define PAIRWISE_BLOCK_SIZE 32
+
+// Pairwise summation, with 4 independent partial sums in the base case
+inline value_type pairwise_sum(const value_type * values, int n) {
+    if (n > PAIRWISE_BLOCK_SIZE) {
+        int half = n / 2;
+        return pairwise_sum(values, half) + pairwise_sum(values + half, n - half);
+    }
+
+    value_type lanes[4] = {0, 0, 0, 0};
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        for (int lane = 0; lane < 4; ++lane)
+            lanes[lane] += values[i + lane];
+    }
+
+    value_type total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n; ++i)
+        total += values[i];
+    return total;
+}
+
+// Neumaier's variant of Kahan summation
+inline value_type compensated_sum(const vector<value_type> & values) {
+    value_type total = 0, compensation = 0;
+    for (auto value : values) {
+        value_type next = total + value;
+        if (abs(total) >= abs(value)) {
+            compensation += (total - next) + value;
+        } else {
+            compensation += (value - next) + total;
+        }
+        total = next;
+    }
+    return total + compensation;
+}
+
+// Evaluates an RPN program on a chunk of rows at a time
+class BatchEvaluator {
+private:
+    // slots[k] holds the values of the k-th element of the stack
+    vector<vector<value_type>> slots;
+    vector<value_type> scratch;
+    vector<const value_type *> stack;
+
+    // Evaluators of the arguments of the conditionals, in order of appearance
+    vector<unique_ptr<BatchEvaluator>> children;
+
+    // Rows taken by every branch of a conditional and their positions in its result
+    vector<int> branch_rows[2];
+    vector<int> branch_positions[2];
+
+    value_type * slot(int position) {
+        if (position >= (int)slots.size()) {
+            slots.resize(position + 1, vector<value_type>(REDUCTION_CHUNK_SIZE));
+        }
+        return slots[position].data();
+    }
+
+    // Returns the values of a column on the evaluated rows
+    const value_type * load(const value_type * column, int position, int begin, int n, const int * rows);
+
+    void evaluate_conditional(const FunctionIf * conditional, value_type * result, int begin, int n,
+                              const value_type * const * arguments, const int * rows, BatchEvaluator & child);
+public:
+    BatchEvaluator () : scratch(REDUCTION_CHUNK_SIZE) {;}
+
+    // Returns the values of the program on rows [begin, begin + n), n <= REDUCTION_CHUNK_SIZE
+    // or, if rows are given, on the n rows begin + rows[i]
+    // Variables take their values from the columns given as arguments, if any
+    // The values are valid until the next call
+    const value_type * evaluate(const Program & program, int begin, int n, const value_type * const * arguments = NULL,
+                                const int * rows = NULL);
+};
+
+//////////////////////////////////////////////////////////////
+
+const value_type * BatchEvaluator::load(const value_type * column, int position, int begin, int n, const int * rows) {
+    if (rows == NULL) {
+        return column + begin;
+    }
+
+    value_type * values = slot(position);
+    for (int i = 0; i < n; ++i)
+        values[i] = column[begin + rows[i]];
+    return values;
+}
+
+void BatchEvaluator::evaluate_conditional(const FunctionIf * conditional, value_type * result, int begin, int n,
+                                          const value_type * const * arguments, const int * rows, BatchEvaluator & child) {
+    const value_type * condition = child.evaluate(conditional->get_argument(0), begin, n, arguments, rows);
+
+    int nr_true = 0;
+    for (int i = 0; i < n; ++i)
+        nr_true += condition[i] != 0;
+
+    if (nr_true == n || nr_true == 0) {
+        const value_type * values = child.evaluate(conditional->get_argument(nr_true ? 1 : 2), begin, n, arguments, rows);
+        copy(values, values + n, result);
+        return;
+    }
+
+    for (int branch = 0; branch < 2; ++branch) {
+        branch_rows[branch].clear();
+        branch_positions[branch].clear();
+    }
+    for (int i = 0; i < n; ++i) {
+        int branch = condition[i] != 0 ? 0 : 1;
+        branch_rows[branch].push_back(rows ? rows[i] : i);
+        branch_positions[branch].push_back(i);
+    }
+
+    for (int branch = 0; branch < 2; ++branch) {
+        int nr_rows = branch_rows[branch].size();
+        const value_type * values = child.evaluate(conditional->get_argument(branch + 1), begin, nr_rows, arguments,
+                                                   branch_rows[branch].data());
+        for (int j = 0; j < nr_rows; ++j)
+            result[branch_positions[branch][j]] = values[j];
+    }
+}
+
+const value_type * BatchEvaluator::evaluate(const Program & program, int begin, int n, const value_type * const * arguments,
+                                            const int * rows) {
+    stack.clear();
+    unsigned int nr_children = 0;
+
+    for (const auto & node : program) {
+        int position = stack.size();
+
+        if (node->get_type() == NODE_SCALAR) {
+            Scalar * current_scalar = dynamic_cast<Scalar*>(node.get());
+            if (current_scalar->is_variable()) {
+                if (arguments == NULL) {
+                    throw string("Variables must be bound to a value");
+                }
+                stack.push_back(load(arguments[current_scalar->get_variable_index()], position, begin, n, rows));
+            } else {
+                value_type * values = slot(position);
+                fill(values, values + n, current_scalar->get_constant());
+                stack.push_back(values);
+            }
+        } else if (node->get_type() == NODE_COLUMN) {
+            stack.push_back(load(dynamic_cast<Column*>(node.get())->get_values(), position, begin, n, rows));
+        } else if (node->get_type() == NODE_AGGREGATE) {
+            value_type * values = slot(position);
+            fill(values, values + n, dynamic_cast<AggregateFunction*>(node.get())->get_value());
+            stack.push_back(values);
+        } else if (node->get_type() == NODE_CONDITIONAL) {
+            if (nr_children == children.size()) {
+                children.push_back(unique_ptr<BatchEvaluator>(new BatchEvaluator()));
+            }
+            value_type * values = slot(position);
+            evaluate_conditional(dynamic_cast<FunctionIf*>(node.get()), values, begin, n, arguments, rows, *children[nr_children++]);
+            stack.push_back(values);
+        } else {
+            Function * current_function = dynamic_cast<Function*>(node.get());
+            int arity = current_function->get_arity();
+            if (position < arity) {
+                throw string("Insufficient number of operands for " + current_function->get_identifier());
+            }
+
+            current_function->apply_batch(&stack[position - arity], scratch.data(), n);
+
+            // The result replaces the operands, its buffer becomes the slot of the first operand
+            stack.resize(position - arity);
+            slot(position - arity);
+            swap(slots[position - arity], scratch);
+            stack.push_back(slots[position - arity].data());
+        }
+    }
+
+    if (stack.size() != 1) {
+        throw string(stack.empty() ? "Insufficient scalars left" : "Too many scalars left");
+    }
+
+    return stack[0];
+}
+
+void AggregateFunction::prepare(const Program & program, int & length) {
+    for (auto & node : program) {
+        if (node->get_type() == NODE_AGGREGATE) {
+            dynamic_cast<AggregateFunction*>(node.get())->reduce();
+        } else if (node->get_type() == NODE_COLUMN) {
+            int column_length = dynamic_cast<Column*>(node.get())->get_length();
+            if (length >= 0 && column_length != length) {
+                throw string("Columns of different lengths used in " + get_identifier());
+            }
+            length = column_length;
+        } else if (node->get_type() == NODE_CONDITIONAL) {
+            FunctionIf * conditional = dynamic_cast<FunctionIf*>(node.get());
+            for (int k = 0; k < conditional->get_arity(); ++k)
+                prepare(conditional->get_argument(k), length);
+        }
+    }
+}
+
+value_type AggregateFunction::reduce() {
+    int length = -1;
+    for (auto & argument : arguments) {
+        prepare(argument, length);
+    }
+
+    if (length < 0) {
+        throw string(get_identifier() + " must be applied over a bound column");
+    }
+
+    int nr_chunks = (length + REDUCTION_CHUNK_SIZE - 1) / REDUCTION_CHUNK_SIZE;
+    vector<value_type> chunk_sums(nr_chunks);
+
+    parallel_for(0, nr_chunks, REDUCTION_MIN_CHUNKS_PER_THREAD, [&](int chunk_begin, int chunk_end) {
+        // Every argument needs its own evaluator since the values are kept in the evaluator buffers
+        vector<BatchEvaluator> evaluators(arguments.size());
+        vector<const value_type *> values(arguments.size());
+        vector<value_type> terms(REDUCTION_CHUNK_SIZE);
+
+        for (int chunk = chunk_begin; chunk < chunk_end; ++chunk) {
+            int begin = chunk * REDUCTION_CHUNK_SIZE;
+            int n = min(REDUCTION_CHUNK_SIZE, length - begin);
+            for (unsigned int k = 0; k < arguments.size(); ++k)
+                values[k] = evaluators[k].evaluate(arguments[k], begin, n);
+            combine(values.data(), terms.data(), n);
+            chunk_sums[chunk] = pairwise_sum(terms.data(), n);
+        }
+    });
+
+    value = finish(compensated_sum(chunk_sums), length);
+    return value;
+}
@@ -0,0 +1,119 @@
+/*
+Push-based Shunting-yard algorithm
+
+Tokens are pushed one at a time and the tokens of the reverse polish notation are passed to the output
+as soon as their position is known, so only the pending operators, functions and parantheses are kept,
+as many as the nesting depth of the expression.
+
+Every token passed to the output between a lazy function (an aggregate or if) and the end of its arguments
+belongs to the arguments, which the output is told so it can keep them together.
+
+The equal sign of an equation has the lowest precedence, "a + b = c + d" becomes "a b + c d + -".
+*/
+
+#pragma once
+
+#include <functional>
+
+#include "Node.h"
+
+class ShuntingYard {
+private:
+    // Receives the tokens in reverse polish notation and whether they are inside the arguments of a lazy function
+    function<void(const Token &, bool)> output;
+
+    // Operators, functions and parantheses not yet passed to the output
+    stack<Token> buffer;
+
+    // Number of lazy functions in the buffer
+    int nr_lazy_functions;
+
+    void pop_to_output();
+public:
+    explicit ShuntingYard (function<void(const Token &, bool)> _output) : output(move(_output)), nr_lazy_functions(0) {;}
+
+    void push(const Token & token);
+
+    // Passes the remaining operators to the output
+    void finish();
+};
+
+//////////////////////////////////////////////////////////////
+
+void ShuntingYard::pop_to_output() {
+    Token token = buffer.top();
+    buffer.pop();
+
+    if (token.token_type == TOKEN_FUNCTION && FunctionFactory::is_lazy(token.symbol)) {
+        --nr_lazy_functions;
+    }
+
+    if (token.token_type == TOKEN_EQUAL_SIGN) {
+        token = Token (TOKEN_OPERATOR, SYMBOL_SUBSTRACT);
+    }
+    output(token, nr_lazy_functions > 0);
+}
+
+void ShuntingYard::push(const Token & token) {
+    if (token.token_type == TOKEN_WHITESPACE) {
+        return;
+    } else if (token.token_type == TOKEN_NUMBER || token.token_type == TOKEN_VARIABLE) {
+        output(token, nr_lazy_functions > 0);
+    } else if (token.token_type == TOKEN_OPERATOR) {
+        auto next_operator = FunctionFactory::build(token);
+        // A prefix operator such as the negation has no left operand, the pending operators are not complete yet
+        bool is_prefix = next_operator->get_arity() == 1;
+        while (!is_prefix && !buffer.empty() && buffer.top().token_type == TOKEN_OPERATOR) {
+            auto peek_operator = FunctionFactory::build(buffer.top());
+            if (peek_operator->get_precedence() >= next_operator->get_precedence()) {
+                pop_to_output();
+            } else {
+                break;
+            }
+        }
+        buffer.push(token);
+    } else if (token.token_type == TOKEN_FUNCTION) {
+        nr_lazy_functions += FunctionFactory::is_lazy(token.symbol);
+        buffer.push(token);
+    } else if (token.token_type == TOKEN_COMMA) {
+        while (!buffer.empty() && buffer.top().token_type != TOKEN_LEFT_PARANTHESES) {
+            pop_to_output();
+        }
+        if (buffer.empty()) {
+            throw string("Invalid function declaration: missing left parantheses");
+        }
+    } else if (token.token_type == TOKEN_EQUAL_SIGN) {
+        while (!buffer.empty() && buffer.top().token_type == TOKEN_OPERATOR) {
+            pop_to_output();
+        }
+        buffer.push(token);
+    } else if (token.token_type == TOKEN_LEFT_PARANTHESES) {
+        buffer.push(token);
+    } else if (token.token_type == TOKEN_RIGHT_PARANTHESES) {
+        while (!buffer.empty() && buffer.top().token_type != TOKEN_LEFT_PARANTHESES) {
+            pop_to_output();
+        }
+
+        if (buffer.empty()) {
+            throw string("Invalid parantheses: missing left parantheses");
+        }
+
+        buffer.pop();
+
+        // A function is applied once its parantheses close
+        if (!buffer.empty() && buffer.top().token_type == TOKEN_FUNCTION) {
+            pop_to_output();
+        }
+    } else {
+        throw string("Unknown token type " + to_string(token.token_type));
+    }
+}
+
+void ShuntingYard::finish() {
+    while (!buffer.empty()) {
+        if (buffer.top().token_type == TOKEN_LEFT_PARANTHESES || buffer.top().token_type == TOKEN_RIGHT_PARANTHESES) {
+            throw string("Mismatched parantheses");
+        }
+        pop_to_output();
+    }
+}
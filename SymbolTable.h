@@ -0,0 +1,68 @@
+/*
+Table of the interned identifiers of a calculator
+
+Tokens and nodes refer to identifiers by their symbol, an index in the table, so every name is stored
+once however many times it occurs in the expressions. The operators and the built-in functions have
+fixed symbols, the other names get the next free symbol the first time they are seen.
+*/
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+enum BuiltinSymbol {SYMBOL_ADD, SYMBOL_SUBSTRACT, SYMBOL_MULTIPLY, SYMBOL_DIVIDE, SYMBOL_NEGATE,
+                    SYMBOL_LESS, SYMBOL_GREATER, SYMBOL_LESS_EQUAL, SYMBOL_GREATER_EQUAL, SYMBOL_EQUAL, SYMBOL_NOT_EQUAL,
+                    SYMBOL_LOG, SYMBOL_MAX, SYMBOL_MIN, SYMBOL_POW, SYMBOL_SIN, SYMBOL_COS,
+                    SYMBOL_SUM, SYMBOL_MEAN, SYMBOL_DOT, SYMBOL_IF, NR_BUILTIN_SYMBOLS};
+
+// Symbol of the tokens and nodes without an identifier, such as numbers and parantheses
+#define NO_SYMBOL -1
+
+class SymbolTable {
+private:
+    vector<string> names;
+    unordered_map<string, int> symbols;
+public:
+    SymbolTable ();
+
+    static const string & builtin_name(int symbol) {
+        static const string builtin_names[NR_BUILTIN_SYMBOLS] = {"+", "-", "*", "/", "~",
+            "<", ">", "<=", ">=", "==", "!=",
+            "log", "max", "min", "pow", "sin", "cos", "sum", "mean", "dot", "if"};
+        return builtin_names[symbol];
+    }
+
+    // Returns the symbol of a name, adding it to the table on first use
+    int intern(const string & name);
+
+    const string & name(int symbol) const {
+        return names[symbol];
+    }
+
+    int size() const {
+        return names.size();
+    }
+};
+
+//////////////////////////////////////////////////////////////
+
+SymbolTable::SymbolTable() {
+    for (int symbol = 0; symbol < NR_BUILTIN_SYMBOLS; ++symbol) {
+        intern(builtin_name(symbol));
+    }
+}
+
+int SymbolTable::intern(const string & name) {
+    auto found = symbols.find(name);
+    if (found != symbols.end()) {
+        return found->second;
+    }
+
+    names.push_back(name);
+    symbols[name] = names.size() - 1;
+    return names.size() - 1;
+}
@@ -0,0 +1,192 @@
+/*
+Work-stealing task scheduler
+
+Every worker thread owns a deque of tasks. Tasks submitted by a worker go to the back of its
+own deque, other tasks go to a shared deque. A worker runs the tasks from the back of its deque
+and steals from the front of the other deques when it runs out of work. Deferred tasks go to the
+shared deque, on the side which their thread takes last, so they run after the tasks already shared.
+
+A thread waiting for tasks to finish does not block: wait_until runs pending tasks on the
+waiting thread until the condition holds, so nested fork-join parallelism can't deadlock,
+even when there are no worker threads at all. The shared instance still keeps a worker, for the
+tasks of threads which never wait.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Parallel.h"
+
+using namespace std;
+
+class TaskScheduler {
+private:
+    struct TaskQueue {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    // queues[0] is shared, queues[k + 1] belongs to the k-th worker
+    vector<unique_ptr<TaskQueue>> queues;
+    vector<thread> workers;
+
+    atomic<bool> stopping;
+    atomic<int> nr_pending;
+    mutex sleep_lock;
+    condition_variable wake_up;
+
+    // Index of the queue owned by the current thread, 0 for threads which are not workers
+    static int & own_queue() {
+        static thread_local int index = 0;
+        return index;
+    }
+
+    bool pop(int queue, bool from_back, function<void()> & task);
+
+    // Takes a task from the own queue or steals one from another queue
+    bool find_task(function<void()> & task);
+
+    void run_worker(int queue);
+
+    void push(int queue, function<void()> task, bool to_back);
+public:
+    // The calling threads also run tasks while waiting, so one worker less than the hardware threads is used
+    explicit TaskScheduler (int nr_workers = hardware_threads() - 1);
+
+    ~TaskScheduler ();
+
+    void submit(function<void()> task);
+
+    // Submits a task which runs after the tasks already in the shared deque
+    void defer(function<void()> task);
+
+    // Runs pending tasks on the calling thread until done returns true
+    void wait_until(const function<bool()> & done);
+
+    // Scheduler shared by the whole process. It keeps a worker even on one hardware thread, so the tasks of
+    // callers which never wait, such as coroutines awaited from an event loop, still run.
+    static TaskScheduler & instance() {
+        static TaskScheduler scheduler(max(hardware_threads() - 1, 1));
+        return scheduler;
+    }
+};
+
+//////////////////////////////////////////////////////////////
+
+TaskScheduler::TaskScheduler(int nr_workers) : stopping(false), nr_pending(0) {
+    for (int k = 0; k <= nr_workers; ++k) {
+        queues.push_back(unique_ptr<TaskQueue>(new TaskQueue()));
+    }
+
+    for (int k = 0; k < nr_workers; ++k) {
+        workers.push_back(thread(&TaskScheduler::run_worker, this, k + 1));
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        lock_guard<mutex> guard(sleep_lock);
+        stopping = true;
+    }
+    wake_up.notify_all();
+
+    for (auto & worker : workers) {
+        worker.join();
+    }
+}
+
+bool TaskScheduler::pop(int queue, bool from_back, function<void()> & task) {
+    lock_guard<mutex> guard(queues[queue]->lock);
+    auto & tasks = queues[queue]->tasks;
+    if (tasks.empty()) {
+        return false;
+    }
+
+    if (from_back) {
+        task = move(tasks.back());
+        tasks.pop_back();
+    } else {
+        task = move(tasks.front());
+        tasks.pop_front();
+    }
+    return true;
+}
+
+bool TaskScheduler::find_task(function<void()> & task) {
+    int own = own_queue();
+    if (own > 0 && pop(own, true, task)) {
+        return true;
+    }
+
+    for (unsigned int k = 0; k < queues.size(); ++k) {
+        int victim = (own + k) % queues.size();
+        if (victim != own && pop(victim, false, task)) {
+            return true;
+        }
+    }
+
+    return own == 0 && pop(0, true, task);
+}
+
+void TaskScheduler::run_worker(int queue) {
+    own_queue() = queue;
+
+    while (!stopping) {
+        function<void()> task;
+        if (find_task(task)) {
+            --nr_pending;
+            task();
+            continue;
+        }
+
+        unique_lock<mutex> guard(sleep_lock);
+        wake_up.wait(guard, [this] { return stopping || nr_pending > 0; });
+    }
+}
+
+void TaskScheduler::push(int queue_index, function<void()> task, bool to_back) {
+    {
+        TaskQueue & queue = *queues[queue_index];
+        lock_guard<mutex> guard(queue.lock);
+        if (to_back) {
+            queue.tasks.push_back(move(task));
+        } else {
+            queue.tasks.push_front(move(task));
+        }
+    }
+
+    {
+        lock_guard<mutex> guard(sleep_lock);
+        ++nr_pending;
+    }
+    wake_up.notify_one();
+}
+
+void TaskScheduler::submit(function<void()> task) {
+    push(own_queue(), move(task), true);
+}
+
+void TaskScheduler::defer(function<void()> task) {
+    // The workers take the shared tasks from the front, the other threads from the back
+    push(0, move(task), own_queue() != 0);
+}
+
+void TaskScheduler::wait_until(const function<bool()> & done) {
+    while (!done()) {
+        function<void()> task;
+        if (find_task(task)) {
+            --nr_pending;
+            task();
+        } else {
+            this_thread::yield();
+        }
+    }
+}
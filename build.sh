@@ -1,2 +1,2 @@
 #!/bin/bash
-g++ -o calculator -O3 -W --std=c++14 calculator.cpp
+g++ -o calculator -O3 -W --std=c++20 -pthread calculator.cpp
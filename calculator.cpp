@@ -1,14 +1,65 @@
 
 #include "Calculator.h"
+#include "AsyncCalculator.h"
 
 Calculator MyCalculator;
 
+void print_enclosures(const vector<Interval> & enclosures, long long evaluations, bool converged) {
+    cout << setprecision(12);
+    for (const auto & enclosure : enclosures)
+        cout << "[" << enclosure.lo << ", " << enclosure.hi << "]\n";
+    cout << "Evaluations: " << evaluations << (converged ? "" : ", stopped before the tolerance was reached") << "\n";
+}
+
+// Runs --roots, --maximum and --minimum: ./calculator --roots a b "expression"
+void search(const string & option, int argc, char* argv[]) {
+    if (argc < 5) {
+        cout << "Usage: ./calculator " << option << " a b \"expression\"" << "\n";
+        return;
+    }
+
+    string expression = "";
+    for (int i = 4; i < argc; ++i)
+        expression += string(argv[i]);
+
+    try {
+        value_type a = stod(argv[2]), b = stod(argv[3]);
+        if (option == "--roots") {
+            auto roots = MyCalculator.find_roots(expression, a, b);
+            cout << "Roots:\n";
+            print_enclosures(roots.roots, roots.evaluations, roots.converged);
+        } else {
+            auto extremum = option == "--maximum" ? MyCalculator.find_maximum(expression, a, b)
+                                                  : MyCalculator.find_minimum(expression, a, b);
+            cout << setprecision(12) << "Value: [" << extremum.value.lo << ", " << extremum.value.hi << "], reached in:\n";
+            print_enclosures(extremum.locations, extremum.evaluations, extremum.converged);
+        }
+    } catch (string error) {
+        cout << "Error: " << error << "\n";
+    } catch (invalid_argument &) {
+        cout << "Error: invalid range" << "\n";
+    }
+}
+
 int main(int argc, char* argv[]) {
     MyCalculator.test();
+    AsyncCalculator::test();
 
     if (argc == 1) {
         cout << "Usage: ./calculator \"expression\"" << "\n";
         cout << "Example: \"./calculator 3 + 4*5\"" << "\n";
+        cout << "Benchmark: \"./calculator --benchmark\"" << "\n";
+        cout << "Streaming from the standard input: \"./calculator --stdin < expression.txt\"" << "\n";
+        cout << "Roots and extrema on [a, b]: \"./calculator --roots|--maximum|--minimum a b expression\"" << "\n";
+    } else if (string(argv[1]) == "--benchmark") {
+        MyCalculator.benchmark();
+        AsyncCalculator::benchmark();
+    } else if (string(argv[1]) == "--roots" || string(argv[1]) == "--maximum" || string(argv[1]) == "--minimum") {
+        search(argv[1], argc, argv);
+    } else if (string(argv[1]) == "--stdin") {
+        FileDescriptorBuffer buffer(0);
+        istream input(&buffer);
+        cout << "Result: " + MyCalculator.eval_stream(input) << "\n";
     } else {
         string expression = "";
 
@@ -0,0 +1,326 @@
+/*
+Performance regression harness for the parser and the evaluator
+
+Every shape of ExpressionGenerator is evaluated at sizes doubling from FUZZ_MIN_SIZE to FUZZ_MAX_SIZE characters,
+by eval and by eval_stream. The time per character and the peak memory allocated during an evaluation are measured
+at every size. A path is flagged when:
+    - its time or memory grows faster than linearly, the slope of their log-log fit exceeding FUZZ_MAX_SLOPE
+    - its throughput at the largest size is below FUZZ_REGRESSION_FACTOR times the one stored in the baseline file
+    - eval and eval_stream return different results for an expression, numbers and error messages alike
+    - the evaluation aborts or throws an exception out of the calculator
+
+Every check runs in its own process, so that a crash is reported as a problem instead of ending the harness.
+
+Build and run with ./fuzz.sh, ./fuzz.sh --update-baseline stores the measured throughputs as the new baseline.
+The exit status is 1 if anything was flagged.
+*/
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Calculator.h"
+#include "ExpressionGenerator.h"
+
+#define FUZZ_MIN_SIZE (1 << 10)
+#define FUZZ_MAX_SIZE (1 << 17)
+// Minimum time spent evaluating an expression, in seconds
+#define FUZZ_MIN_TIME 0.05
+// Linear paths have slope 1, the noise of the measurements stays well below the margin
+#define FUZZ_MAX_SLOPE 1.25
+// The slopes are fitted on the largest sizes, where the constant costs such as the chunk of the lexer matter least
+#define FUZZ_FIT_POINTS 4
+// Baselines are measured on other machines and under other loads, only large drops are regressions
+#define FUZZ_REGRESSION_FACTOR 0.5
+#define FUZZ_NR_RANDOM 2000
+#define FUZZ_BASELINE "fuzz_baseline.txt"
+
+//////////////////////////////////////////
+//  Memory accounting
+//////////////////////////////////////////
+
+// Every block is prefixed by its size, the prefix keeps the alignment of malloc
+#define ALLOCATION_HEADER 16
+
+atomic<long long> live_bytes(0), peak_bytes(0), nr_allocations(0);
+
+void * operator new(size_t size) {
+    char * block = (char *)malloc(size + ALLOCATION_HEADER);
+    if (!block) {
+        throw bad_alloc();
+    }
+    *(size_t *)block = size;
+
+    long long live = live_bytes += size;
+    long long peak = peak_bytes;
+    while (live > peak && !peak_bytes.compare_exchange_weak(peak, live)) {;}
+    ++nr_allocations;
+
+    return block + ALLOCATION_HEADER;
+}
+
+void operator delete(void * pointer) noexcept {
+    if (pointer) {
+        char * block = (char *)pointer - ALLOCATION_HEADER;
+        live_bytes -= *(size_t *)block;
+        free(block);
+    }
+}
+
+void * operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete[](void * pointer) noexcept {
+    operator delete(pointer);
+}
+
+void operator delete(void * pointer, size_t) noexcept {
+    operator delete(pointer);
+}
+
+void operator delete[](void * pointer, size_t) noexcept {
+    operator delete(pointer);
+}
+
+//////////////////////////////////////////
+//  Measurements
+//////////////////////////////////////////
+
+struct Measurement {
+    int size;
+    // Seconds per evaluation
+    double time;
+    // Peak bytes allocated during an evaluation and number of allocations
+    long long memory, allocations;
+};
+
+string evaluate(Calculator & calculator, const string & expression, bool streaming) {
+    if (!streaming) {
+        return calculator.eval(expression);
+    }
+    istringstream input(expression);
+    return calculator.eval_stream(input);
+}
+
+Measurement measure(Calculator & calculator, const string & expression, bool streaming, string & result) {
+    Measurement measurement;
+    measurement.size = expression.size();
+
+    // The input stream is a copy of the expression, only the memory of the parser is counted
+    istringstream input(expression);
+    long long live = live_bytes, allocations = nr_allocations;
+    peak_bytes = live;
+    result = streaming ? calculator.eval_stream(input) : calculator.eval(expression);
+    measurement.memory = peak_bytes - live;
+    measurement.allocations = nr_allocations - allocations;
+
+    int repetitions = 0;
+    auto start = chrono::steady_clock::now();
+    double elapsed;
+    do {
+        evaluate(calculator, expression, streaming);
+        ++repetitions;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    } while (elapsed < FUZZ_MIN_TIME);
+
+    measurement.time = elapsed / repetitions;
+    return measurement;
+}
+
+// Slope of the least squares fit of log(y) against log(x) over the last FUZZ_FIT_POINTS points
+double log_log_slope(const vector<double> & x, const vector<double> & y) {
+    int first = max((int)x.size() - FUZZ_FIT_POINTS, 0);
+    double n = x.size() - first, sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+    for (unsigned int i = first; i < x.size(); ++i) {
+        double lx = log(x[i]), ly = log(max(y[i], 1e-12));
+        sum_x += lx;
+        sum_y += ly;
+        sum_xx += lx * lx;
+        sum_xy += lx * ly;
+    }
+    return (n * sum_xy - sum_x * sum_y) / (n * sum_xx - sum_x * sum_x);
+}
+
+map<string, double> read_baseline() {
+    map<string, double> baseline;
+    ifstream file(FUZZ_BASELINE);
+    string shape, mode;
+    double throughput;
+    while (file >> shape >> mode >> throughput) {
+        baseline[shape + " " + mode] = throughput;
+    }
+    return baseline;
+}
+
+// Random expressions must evaluate to the same result whether they are read from a string or a stream
+int check_random_expressions() {
+    Calculator calculator;
+    ExpressionGenerator generator(1);
+    int nr_failures = 0;
+    for (int i = 0; i < FUZZ_NR_RANDOM; ++i) {
+        string expression = generator.random(1 + i % 2000);
+        string result = calculator.eval(expression);
+        string streamed = evaluate(calculator, expression, true);
+        if (result.empty() || result != streamed) {
+            if (++nr_failures <= 5) {
+                cout << "FAILED " << expression << "\n    eval: " << result << "\n    eval_stream: " << streamed << "\n";
+            }
+        }
+    }
+    cout << FUZZ_NR_RANDOM << " random expressions, " << nr_failures << " failures\n";
+    return nr_failures;
+}
+
+// Measures both modes of a shape at every size, writes the throughputs at the largest size to new_baseline
+int check_shape(const string & shape, map<string, double> & baseline, ostream & new_baseline) {
+    Calculator calculator;
+    int nr_flags = 0;
+    map<int, string> results;
+
+    for (bool streaming : {false, true}) {
+        string mode = streaming ? "stream" : "eval";
+        ExpressionGenerator generator(2);
+
+        vector<double> sizes, times, memories;
+        double throughput = 0;
+        for (int size = FUZZ_MIN_SIZE; size <= FUZZ_MAX_SIZE; size *= 2) {
+            string expression = generator.shape(shape, size), result;
+            Measurement measurement = measure(calculator, expression, streaming, result);
+
+            // Numbers and error messages are both results, as long as both modes return the same one
+            if (result.empty() || (streaming && result != results[size])) {
+                cout << "FAILED " << shape << " " << mode << " of size " << size << ": " << result << "\n";
+                ++nr_flags;
+            }
+            results[size] = result;
+
+            throughput = measurement.size / measurement.time / 1e6;
+            sizes.push_back(measurement.size);
+            times.push_back(measurement.time);
+            // A few bytes stand for the constant memory, so that its slope is 0 rather than undefined
+            memories.push_back(measurement.memory + 1024);
+
+            cout << setw(12) << shape << setw(8) << mode << setw(10) << measurement.size
+                 << setw(12) << fixed << setprecision(1) << measurement.time * 1e6
+                 << setw(10) << setprecision(2) << throughput
+                 << setw(12) << measurement.memory << setw(13) << measurement.allocations << "\n";
+        }
+
+        double time_slope = log_log_slope(sizes, times), memory_slope = log_log_slope(sizes, memories);
+        cout << setw(20) << "slopes" << ": time " << setprecision(2) << time_slope << ", memory " << memory_slope;
+        if (time_slope > FUZZ_MAX_SLOPE || memory_slope > FUZZ_MAX_SLOPE) {
+            cout << "  SUPER-LINEAR";
+            ++nr_flags;
+        }
+
+        string key = shape + " " + mode;
+        if (baseline.count(key)) {
+            cout << ", baseline " << baseline[key] << " MB/s";
+            if (throughput < FUZZ_REGRESSION_FACTOR * baseline[key]) {
+                cout << "  REGRESSION";
+                ++nr_flags;
+            }
+        }
+        cout << "\n";
+
+        new_baseline << key << " " << fixed << setprecision(2) << throughput << "\n";
+    }
+    return nr_flags;
+}
+
+// Runs a check in a child process, so that an abort or an uncaught exception is reported instead of ending the harness.
+// The first line of the report is the number of problems found by the check, followed by what it wrote to output.
+// Returns false if the child did not exit normally.
+bool run_isolated(const function<int(ostream &)> & check, string & report) {
+    int fds[2];
+    if (pipe(fds) < 0) {
+        throw string("Can't create a pipe");
+    }
+
+    cout.flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+        throw string("Can't create a process");
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        stringstream output;
+        int nr_flags = check(output);
+        string child_report = to_string(nr_flags) + "\n" + output.str();
+        cout.flush();
+        for (size_t written = 0; written < child_report.size();) {
+            ssize_t nr_written = write(fds[1], child_report.data() + written, child_report.size() - written);
+            if (nr_written <= 0) {
+                _exit(1);
+            }
+            written += nr_written;
+        }
+        _exit(0);
+    }
+
+    close(fds[1]);
+    report.clear();
+    char buffer[4096];
+    ssize_t nr_read;
+    while ((nr_read = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        report.append(buffer, nr_read);
+    }
+    close(fds[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (WIFSIGNALED(status)) {
+        cout << "CRASHED with signal " << WTERMSIG(status) << " (" << strsignal(WTERMSIG(status)) << ")\n";
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, char* argv[]) {
+    bool update_baseline = argc > 1 && string(argv[1]) == "--update-baseline";
+
+    // The calculator only runs in the children: forking a process whose scheduler has started its workers is not safe
+    int nr_flags = 0;
+    string report;
+    if (!run_isolated([](ostream &) { return check_random_expressions(); }, report)) {
+        cout << "FAILED random expressions ended abnormally\n";
+        ++nr_flags;
+    }
+    nr_flags += atoi(report.c_str());
+
+    auto baseline = read_baseline();
+    stringstream new_baseline;
+
+    cout << "\n" << setw(12) << "shape" << setw(8) << "mode" << setw(10) << "size" << setw(12) << "time (us)"
+         << setw(10) << "MB/s" << setw(12) << "memory (B)" << setw(13) << "allocations" << "\n";
+
+    for (const auto & shape : ExpressionGenerator::shapes()) {
+        auto check = [&](ostream & output) { return check_shape(shape, baseline, output); };
+        if (!run_isolated(check, report)) {
+            cout << "FAILED " << shape << " ended abnormally\n";
+            ++nr_flags;
+        }
+
+        istringstream lines(report);
+        string line;
+        getline(lines, line);
+        nr_flags += atoi(line.c_str());
+        while (getline(lines, line)) {
+            new_baseline << line << "\n";
+        }
+    }
+
+    if (update_baseline) {
+        ofstream(FUZZ_BASELINE) << new_baseline.str();
+        cout << "\nBaseline written to " << FUZZ_BASELINE << "\n";
+    }
+
+    cout << "\n" << nr_flags << " problems found\n";
+    return nr_flags ? 1 : 0;
+}
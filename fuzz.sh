@@ -0,0 +1,2 @@
+#!/bin/bash
+g++ -o fuzz -O3 -W --std=c++20 -pthread fuzz.cpp && ./fuzz "$@"